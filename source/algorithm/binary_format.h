@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// 二进制压缩文件格式：文件头、段表、各段数据
+// 所有数值均为小端序，每段的起点和段内每个数组的起点都按alignment字节对齐(相对文件起点)
+// grid号以uint16保存，连接性中的grid号加1后保存，使seed的-1变为0，因此要求N_bins * N_bins < 65535
+struct BinaryFormat {
+	static constexpr char magic[8] = { 'M', 'E', 'S', 'H', 'C', 'M', 'P', '\0' };
+	static constexpr uint32_t version = 1;
+	static constexpr uint32_t alignment = 16;
+
+	// 段的类型，同一类型在文件中最多出现一次
+	enum class Section : uint32_t {
+		Features = 1, // 特征数，每个特征的FeatureHeader和字典(float，列优先)，共享字典时不保存字典
+		Codes = 2, // 每个特征的编码：稠密为atoms × columns的float矩阵(列优先)，稀疏为CSR格式的offset、index、value
+		Clusters = 3, // 每个patch所属的聚类(int32)，仅有多个特征时存在
+		Patches = 4, // Raw为每个patch的PatchRecord，Delta见Encoding
+		Masks = 5, // 掩码：Raw为每个patch的起始位置(int32，patch数+1个)和grid号(uint16)，Bitset见Encoding
+		Connectivity = 6, // 面数(uint32 × 4)，patch内的面、两个顶点属于相同patch的缝隙面、三个顶点属于不同patch的缝隙面
+		Bounds = 7, // 每个patch的PatchBound，用于只解码部分区域，可以没有
+		// 渐进布局的字典和编码，此时Features段只有FeatureHeader，没有Codes段：层数(uint32)、保留(uint32)、各层相对段起点的偏移(uint64 × (层数+1))，
+		// 第k层依次为atoms > k的各特征的字典第k列(共享字典时没有)和编码第k行，每个特征之后对齐；
+		// Raw时二者均为对齐的float数组；Quantized时字典列为offset、step(float)和对齐的16位量化数据，编码行为对齐的offset、step(float)、位数(uint8)和对齐的位流
+		// 带entropy_coded标志时每层单独经过rans_encode，段整体不编码；Atoms段总在文件最后，文件只有前几层时可以解码已完整的层
+		Atoms = 8
+	};
+
+	// 段数据的编码方式，记录在SectionEntry::encoding的低8位，未说明的段只使用Raw
+	enum class Encoding : uint32_t {
+		Raw = 0, // float原样保存
+		// Features：每个字典的各列量化为16位，依次为offset(float × atoms)、step(float × atoms)和量化数据(每列rows × 2字节)
+		// Codes：稠密编码按行(原子)量化，依次为offset(float × atoms)、step(float × atoms)、位数(uint8 × atoms)和位流，
+		// 每行从新的字节开始，占quantized_bytes(columns, bits)字节；稀疏编码不量化
+		Quantized = 1,
+		// Masks：每个patch一个N_bins * N_bins位的位图，占(N_bins * N_bins + 7) / 8字节，字节b的第i位(从低位起)表示grid 8b+i有顶点
+		Bitset = 2,
+		// Patches：seed坐标和法线的6个分量各自按float的位模式(uint32)与上一个patch的同一分量相减(首个patch与0相减)，zigzag后拆成4个字节平面，
+		// 依次为分量0的第0(最低)~3字节、分量1的第0~3字节...，每个平面patch数字节；
+		// 然后是对齐的网格尺寸(float × patch数)和对齐的采样网格位移(float × 2 × patch数)
+		Delta = 3
+	};
+	// SectionEntry::encoding中的标志位：段数据整体经过rans_encode熵编码，解码后按低8位的编码方式读取
+	static constexpr uint32_t entropy_coded = 0x100;
+
+	struct FileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t header_size; // 文件头字节数，段表紧跟在文件头之后
+		uint32_t N_bins;
+		uint32_t patch_num;
+		uint32_t section_count;
+		uint32_t reserved;
+	};
+
+	struct SectionEntry {
+		uint32_t type; // Section
+		uint32_t encoding; // Encoding，可带entropy_coded标志
+		uint64_t offset; // 相对文件起点
+		uint64_t size;
+	};
+
+	struct FeatureHeader {
+		int32_t rows; // 特征长度，即N_bins * N_bins
+		int32_t atoms; // 字典列数
+		int32_t columns; // 编码列数，即该聚类的patch数
+		int32_t sparsity; // 稀疏编码每列最多的非零项数，0表示稠密编码
+		uint64_t shared_hash; // 共享字典文件的哈希，0表示字典保存在文件中
+		uint64_t nonzeros; // 稀疏编码的非零项总数
+	};
+
+	struct PatchRecord {
+		float seed[3]; // seed坐标
+		float normal[3]; // seed法线
+		float grid_span; // 网格尺寸
+		float seed_bias[2]; // 采样网格的位移
+	};
+
+	// 按解码后的顶点(含量化误差)计算的包围球
+	struct PatchBound {
+		float center[3];
+		float radius;
+	};
+
+	// 文件是否以magic开头
+	static bool match(const char* data, size_t size) {
+		return size >= sizeof(magic) && std::memcmp(data, magic, sizeof(magic)) == 0;
+	}
+};
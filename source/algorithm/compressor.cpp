@@ -1,12 +1,52 @@
 ﻿#include "compressor.h"
 
+#include <algorithm/binary_format.h>
+#include <algorithm/grid_kernel.h>
+#include <algorithm/local_frame.h>
+#include <algorithm/parser.h>
+#include <algorithm/quantizer.h>
+#include <tools/binary_io.h>
+#include <tools/bit_ops.h>
+#include <tools/hash.h>
+#include <tools/load_obj_mesh.h>
+#include <tools/rans.h>
+#include <tools/radix_sort.h>
 #include <cmath>
+#include <cstdio>
 #include <numeric>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <execution>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <list>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+// 确定性模式下在压缩期间把Eigen固定为单线程，析构时恢复原来的线程数
+// Eigen::setNbThreads是整个进程共用的设置，不能在init中设置后一直保留，否则会影响其他使用Eigen的代码
+class EigenThreadScope {
+public:
+	explicit EigenThreadScope(bool single_thread) : previous(Eigen::nbThreads()) {
+		if (single_thread) Eigen::setNbThreads(1); // Eigen启用OpenMP时矩阵乘法的分块与线程数有关
+	}
+	~EigenThreadScope() {
+		Eigen::setNbThreads(previous);
+	}
+
+private:
+	int previous;
+};
 
 Compressor::Compressor() {
 }
@@ -15,54 +55,152 @@ Compressor::~Compressor() {
 }
 
 void Compressor::init(const std::vector<Eigen::Vector3f>* _vertices, const std::vector<std::vector<int>>* _faces, 
-	const std::vector<Eigen::Vector3f>* _normals, int _N_bins, int _patch_size_limit, float _patch_normal_tolerance, int _float_precision) {
+	const std::vector<Eigen::Vector3f>* _normals, const Config& config) {
 	origin_vertices = _vertices;
 	origin_faces = _faces;
 	origin_normals = _normals;
+	init_config = config;
 
 	std::vector<int>(_vertices->size(), -1).swap(vertex_to_patch);
 	std::vector<int>(_vertices->size(), -1).swap(vertex_to_grid);
 	std::vector<float>(_vertices->size()).swap(vertex_curvature);
 
-	N_bins = _N_bins;
-	patch_size_limit = _patch_size_limit;
-	patch_normal_tolerance = _patch_normal_tolerance;
-	float_precision = _float_precision;
+	N_bins = config.N_bins;
+	patch_size_limit = config.patch_size_limit;
+	patch_normal_tolerance = config.patch_normal_tolerance;
+	if (config.patch_growth == "geodesic") {
+		patch_growth = PatchGrowth::Geodesic;
+	}
+	else {
+		if (config.patch_growth != "bfs") {
+			std::cout << "LOG: 未知的patch_growth \"" << config.patch_growth << "\"，使用bfs" << std::endl;
+		}
+		patch_growth = PatchGrowth::BFS;
+	}
+	if (config.patch_order == "morton") {
+		patch_order = PatchOrder::Morton;
+	}
+	else {
+		if (config.patch_order != "curvature") {
+			std::cout << "LOG: 未知的patch_order \"" << config.patch_order << "\"，使用curvature" << std::endl;
+		}
+		patch_order = PatchOrder::Curvature;
+	}
+	if (config.svd_backend == "gram") {
+		svd_backend = SvdBackend::Gram;
+	}
+	else if (config.svd_backend == "bdc") {
+		svd_backend = SvdBackend::BDC;
+	}
+	else if (config.svd_backend == "randomized") {
+		svd_backend = SvdBackend::Randomized;
+	}
+	else {
+		if (config.svd_backend != "jacobi") {
+			std::cout << "LOG: 未知的svd_backend \"" << config.svd_backend << "\"，使用jacobi" << std::endl;
+		}
+		svd_backend = SvdBackend::Jacobi;
+	}
+	svd_oversampling = config.svd_oversampling;
+	svd_power_iterations = config.svd_power_iterations;
+	verbose = config.verbose;
+	target_rms_error = config.target_rms_error;
+	target_energy = config.target_energy;
+	masked_iterations = config.masked_iterations;
+	sparsity = config.sparsity;
+	sparse_atoms = config.sparse_atoms;
+	sparse_iterations = config.sparse_iterations;
+	clusters = config.clusters;
+	cluster_iterations = config.cluster_iterations;
+	coding_chunk = config.coding_chunk; // 下面的模式检查依赖coding_chunk，须先赋值
+	if (clusters > 1 && coding_chunk > 0) {
+		std::cout << "LOG: 流式编码不保存特征矩阵，不进行聚类" << std::endl;
+		clusters = 1;
+	}
+	if (masked_iterations > 0 && (coding_chunk > 0 || sparsity > 0)) {
+		std::cout << "LOG: 流式编码和稀疏编码不支持掩码加权ALS" << std::endl;
+		masked_iterations = 0;
+	}
+	if (sparsity > 0 && coding_chunk > 0) {
+		std::cout << "LOG: 流式编码不支持稀疏编码，使用稠密编码" << std::endl;
+		sparsity = 0;
+	}
+	float_precision = config.float_precision;
+	if (config.file_format == "binary") {
+		file_format = FileFormat::Binary;
+	}
+	else {
+		if (config.file_format != "text") {
+			std::cout << "LOG: 未知的file_format \"" << config.file_format << "\"，使用text" << std::endl;
+		}
+		file_format = FileFormat::Text;
+	}
+	quantization_error = config.quantization_error;
+	entropy_coding = config.entropy_coding;
+	progressive = config.progressive;
+	if (file_format == FileFormat::Text && (quantization_error > 0.0f || entropy_coding || progressive)) {
+		std::cout << "LOG: quantization_error、entropy_coding和progressive只用于二进制格式，文本格式忽略这些选项" << std::endl;
+	}
+	if (progressive && sparsity > 0) {
+		std::cout << "LOG: 稀疏编码的每个patch使用不同的原子，不使用渐进布局" << std::endl;
+		progressive = false;
+	}
+	thread_pool.init(config.threads);
+	deterministic = config.deterministic;
+	// 确定性模式下每轮的seed数固定，使patch划分与线程数无关；否则按线程数决定，以充分利用线程
+	seed_batch = deterministic ? 64 : thread_pool.size() * 4;
 }
 
 void Compressor::generate_edge_parameter() {
-	for (const auto& face : *origin_faces) {
-		Eigen::Vector3f v0 = origin_vertices->at(face[0]);
-		Eigen::Vector3f v1 = origin_vertices->at(face[1]);
-		Eigen::Vector3f v2 = origin_vertices->at(face[2]);
-
-		Eigen::Vector3f n0 = origin_normals->at(face[0]);
-		Eigen::Vector3f n1 = origin_normals->at(face[1]);
-		Eigen::Vector3f n2 = origin_normals->at(face[2]);
-
-		float dis01 = (v0 - v1).norm();
-		float dis02 = (v0 - v2).norm();
-		float dis12 = (v1 - v2).norm();
+	int vertices_num = origin_vertices->size();
 
-		float curvature01 = (n0 - n1).dot(v0 - v1) / (v0 - v1).squaredNorm();
-		float curvature02 = (n0 - n2).dot(v0 - v2) / (v0 - v2).squaredNorm();
-		float curvature12 = (n1 - n2).dot(v1 - v2) / (v1 - v2).squaredNorm();
+	// 遍历一次所有面，把每个面的6条有向边按起点分桶写入邻接数组，相邻面共享的边会被写入两次，稍后去重
+	std::vector<int>(vertices_num + 1, 0).swap(adjacency_offset);
+	for (const auto& face : *origin_faces) {
+		adjacency_offset[face[0] + 1] += 2;
+		adjacency_offset[face[1] + 1] += 2;
+		adjacency_offset[face[2] + 1] += 2;
+	}
+	for (int i = 0; i < vertices_num; ++i) {
+		adjacency_offset[i + 1] += adjacency_offset[i];
+	}
+	std::vector<int>(adjacency_offset[vertices_num]).swap(adjacency_vertex);
+	std::vector<int> fill(adjacency_offset.begin(), adjacency_offset.end() - 1); // 每个桶当前的写入位置
+	for (const auto& face : *origin_faces) {
+		adjacency_vertex[fill[face[0]]++] = face[1];
+		adjacency_vertex[fill[face[0]]++] = face[2];
+		adjacency_vertex[fill[face[1]]++] = face[0];
+		adjacency_vertex[fill[face[1]]++] = face[2];
+		adjacency_vertex[fill[face[2]]++] = face[0];
+		adjacency_vertex[fill[face[2]]++] = face[1];
+	}
 
-		// 距离
-		edge_parameter[face[0]][face[1]].push_back(dis01);
-		edge_parameter[face[0]][face[2]].push_back(dis02);
-		edge_parameter[face[1]][face[0]].push_back(dis01);
-		edge_parameter[face[1]][face[2]].push_back(dis12);
-		edge_parameter[face[2]][face[0]].push_back(dis02);
-		edge_parameter[face[2]][face[1]].push_back(dis12);
+	// 每个桶内排序去重，并原地压缩成紧凑的CSR
+	int edge_num = 0;
+	for (int i = 0; i < vertices_num; ++i) {
+		auto bucket_begin = adjacency_vertex.begin() + adjacency_offset[i];
+		auto bucket_end = adjacency_vertex.begin() + adjacency_offset[i + 1];
+		std::sort(bucket_begin, bucket_end);
+		auto unique_end = std::unique(bucket_begin, bucket_end);
+		adjacency_offset[i] = edge_num;
+		edge_num = std::copy(bucket_begin, unique_end, adjacency_vertex.begin() + edge_num) - adjacency_vertex.begin();
+	}
+	adjacency_offset[vertices_num] = edge_num;
+	adjacency_vertex.resize(edge_num);
+	adjacency_vertex.shrink_to_fit();
 
-		// 曲率
-		edge_parameter[face[0]][face[1]].push_back(curvature01);
-		edge_parameter[face[0]][face[2]].push_back(curvature02);
-		edge_parameter[face[1]][face[0]].push_back(curvature01);
-		edge_parameter[face[1]][face[2]].push_back(curvature12);
-		edge_parameter[face[2]][face[0]].push_back(curvature02);
-		edge_parameter[face[2]][face[1]].push_back(curvature12);
+	// 计算边的距离和曲率
+	std::vector<float>(edge_num).swap(edge_length);
+	std::vector<float>(edge_num).swap(edge_curvature);
+	for (int i = 0; i < vertices_num; ++i) {
+		const Eigen::Vector3f& v0 = origin_vertices->at(i);
+		const Eigen::Vector3f& n0 = origin_normals->at(i);
+		for (int edge = adjacency_offset[i]; edge < adjacency_offset[i + 1]; ++edge) {
+			const Eigen::Vector3f& v1 = origin_vertices->at(adjacency_vertex[edge]);
+			const Eigen::Vector3f& n1 = origin_normals->at(adjacency_vertex[edge]);
+			edge_length[edge] = (v0 - v1).norm();
+			edge_curvature[edge] = (n0 - n1).dot(v0 - v1) / (v0 - v1).squaredNorm();
+		}
 	}
 }
 
@@ -78,23 +216,71 @@ void Compressor::generate_patches() {
 	std::vector<int> vertex_rank(vertices_num); // 按照曲率从大到小进行排序
 	for (int i = 0; i < vertices_num; ++i) {
 		float max_curvature = float(-2e9), min_curvature = float(2e9); // 相邻边的曲率中的最大者和最小者
-		for (const auto& edge : edge_parameter[i]) {
-			max_curvature = std::max(max_curvature, edge.second[1]);
-			min_curvature = std::min(min_curvature, edge.second[1]);
+		for (int edge = adjacency_offset[i]; edge < adjacency_offset[i + 1]; ++edge) {
+			max_curvature = std::max(max_curvature, edge_curvature[edge]);
+			min_curvature = std::min(min_curvature, edge_curvature[edge]);
 		}
 		vertex_curvature[i] = max_curvature * min_curvature;
 		vertex_rank[i] = i;
 	}
 	auto comp = [&](int a, int b) -> bool {
-		return abs(vertex_curvature[a]) > abs(vertex_curvature[b]);
+		float curvature_a = std::abs(vertex_curvature[a]), curvature_b = std::abs(vertex_curvature[b]);
+		return curvature_a == curvature_b ? a < b : curvature_a > curvature_b; // 曲率相同时按顶点号排序，保证并行排序结果唯一
 	};
-	sort(vertex_rank.begin(), vertex_rank.end(), comp);
+	std::sort(std::execution::par, vertex_rank.begin(), vertex_rank.end(), comp);
 
 	// 生成patch
-	std::vector<bool> covered(vertices_num, false); // 是否已被seed覆盖，已被覆盖的点可以再次被覆盖，但不能作为新的seed
+	std::vector<char> covered(vertices_num, false); // 是否已被seed覆盖，已被覆盖的点可以再次被覆盖，但不能作为新的seed
+	if (deterministic || thread_pool.size() > 1) {
+		grow_patches_concurrently(vertex_rank, covered);
+	}
+	else {
+		grow_patches_serially(vertex_rank, covered);
+	}
+
+	// 记录patch数量
+	patch_num = patch_vertices.size();
+	if (patch_order == PatchOrder::Morton) {
+		reorder_patches();
+	}
+	for (const auto& it : patch_vertices) {
+		patch_size.push_back(it.size());
+	}
+}
+
+void Compressor::reorder_patches() {
+	// seed坐标在包围盒内按最长边等比例量化为21位整数，各轴使用相同的比例
+	Eigen::AlignedBox3f box;
+	for (const auto& patch : patch_vertices) {
+		box.extend(origin_vertices->at(patch[0]));
+	}
+	float extent = patch_num > 0 ? box.sizes().maxCoeff() : 0.0f;
+	float scale = extent > 0.0f ? float((1 << 21) - 1) / extent : 0.0f;
+	std::vector<std::pair<uint64_t, int>> order(patch_num); // (Morton码, 原patch号)，Morton码相同时按原patch号排序，结果唯一
+	for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+		Eigen::Vector3f cord = (origin_vertices->at(patch_vertices[patch_id][0]) - box.min()) * scale;
+		order[patch_id] = { morton_code(uint32_t(cord[0]), uint32_t(cord[1]), uint32_t(cord[2])), patch_id };
+	}
+	std::sort(order.begin(), order.end());
+
+	std::vector<int> new_id(patch_num);
+	std::vector<std::vector<int>> reordered(patch_num);
+	for (int i = 0; i < patch_num; ++i) {
+		new_id[order[i].second] = i;
+		reordered[i] = std::move(patch_vertices[order[i].second]);
+	}
+	patch_vertices.swap(reordered);
+	for (int& patch_id : vertex_to_patch) {
+		if (patch_id >= 0) patch_id = new_id[patch_id];
+	}
+}
+
+void Compressor::grow_patches_serially(const std::vector<int>& vertex_rank, std::vector<char>& covered) {
+	int vertices_num = vertex_rank.size();
+	std::vector<std::pair<float, int>> heap; // 测地距离生长时的二叉小根堆，记录(距离, 顶点)
+	int next_seed = 0; // 已覆盖的点不会再变回未覆盖，因此vertex_rank中next_seed之前的点都已被覆盖，下次从这里继续寻找
 	while (true) {
 		// 寻找新seed
-		int next_seed = 0;
 		while (next_seed < vertices_num && covered[vertex_rank[next_seed]]) ++next_seed;
 		if (next_seed == vertices_num) break;
 		int seed_id = vertex_rank[next_seed];
@@ -105,6 +291,35 @@ void Compressor::generate_patches() {
 		vertex_to_patch[seed_id] = patch_id;
 		covered[seed_id] = true;
 
+		if (patch_growth == PatchGrowth::Geodesic) {
+			// 使用Dijkstra按测地距离由近到远生成patch，堆中可能有同一顶点的多条记录，出堆时跳过已覆盖的
+			float pi = atan2(0.0f, -1.0f);
+			float cos_tolerance = cos(patch_normal_tolerance * pi / 180);
+			auto relax = [&](int vertex, float distance) {
+				for (int edge = adjacency_offset[vertex]; edge < adjacency_offset[vertex + 1]; ++edge) {
+					int to_vertex = adjacency_vertex[edge];
+					if (covered[to_vertex]) continue;
+					if (origin_normals->at(seed_id).dot(origin_normals->at(to_vertex)) <= cos_tolerance) continue; // 对法线方向做约束
+					heap.emplace_back(distance + edge_length[edge], to_vertex);
+					std::push_heap(heap.begin(), heap.end(), std::greater<std::pair<float, int>>());
+				}
+			};
+			heap.clear();
+			relax(seed_id, 0.0f);
+			while (!heap.empty() && patch_vertices[patch_id].size() < patch_size_limit) {
+				std::pop_heap(heap.begin(), heap.end(), std::greater<std::pair<float, int>>());
+				float distance = heap.back().first;
+				int vertex = heap.back().second;
+				heap.pop_back();
+				if (covered[vertex]) continue;
+				patch_vertices[patch_id].push_back(vertex);
+				vertex_to_patch[vertex] = patch_id;
+				covered[vertex] = true;
+				relax(vertex, distance);
+			}
+			continue;
+		}
+
 		// 使用bfs泛洪法生成patch
 		std::list<int> border; // 扩展边界，即bfs队列
 		std::set<int> patch;
@@ -117,8 +332,8 @@ void Compressor::generate_patches() {
 		while (border.size() != 0 && !full) {
 			int vertex = border.front();
 			border.pop_front();
-			for (const auto& connection : edge_parameter[vertex]) {
-				int to_vertex = connection.first;
+			for (int edge = adjacency_offset[vertex]; edge < adjacency_offset[vertex + 1]; ++edge) {
+				int to_vertex = adjacency_vertex[edge];
 				if (covered[to_vertex]) continue;
 				if (origin_normals->at(seed_id).dot(origin_normals->at(to_vertex)) <= cos_tolerance) continue; // 对法线方向做约束，与种子点法线的夹角不超过90度
 				border.push_back(to_vertex);
@@ -137,11 +352,188 @@ void Compressor::generate_patches() {
 		// TODO:邻居很少的点不能作为种子
 		// 因为输入不是扫描得到的点云，本身就比较规整，所以暂且忽略这一步
 	}
+}
 
-	// 记录patch数量
-	patch_num = patch_vertices.size();
-	for (const auto& it : patch_vertices) {
-		patch_size.push_back(it.size());
+void Compressor::grow_patches_concurrently(const std::vector<int>& vertex_rank, std::vector<char>& covered) {
+	int vertices_num = vertex_rank.size();
+	float pi = atan2(0.0f, -1.0f);
+	float cos_tolerance = cos(patch_normal_tolerance * pi / 180);
+
+	// 同一轮的seed之间至少相隔separation跳，使各patch在正常生长范围内互不接触(三角网格上半径r跳的邻域约有3r^2个顶点)
+	int grow_radius = int(std::ceil(std::sqrt(patch_size_limit / 3.0f)));
+	int separation = 2 * grow_radius + 1;
+	int batch_limit = seed_batch; // 每轮最多同时生长的patch数
+	int scan_limit = batch_limit * 64; // 每轮从游标开始最多检查多少个候选seed
+
+	// 顶点的认领标记，高32位为优先级(bfs时为0，测地距离生长时为距离)，低32位为batch内序号，多个patch争夺同一顶点时取最小值，
+	// 即距离近者优先、距离相同时序号小(seed曲率大)者优先，结果与线程调度无关
+	const uint64_t unclaimed = UINT64_MAX;
+	std::unique_ptr<std::atomic<uint64_t>[]> claim(new std::atomic<uint64_t>[vertices_num]);
+	for (int i = 0; i < vertices_num; ++i) {
+		claim[i].store(unclaimed, std::memory_order_relaxed);
+	}
+
+	std::vector<int> blocked(vertices_num, -1); // 顶点在第几轮被已选seed的邻域占用
+	std::vector<int> ball, next_ball; // 标记邻域时的bfs层
+	std::vector<int> batch_seed;
+	std::vector<std::vector<int>> frontier(batch_limit), next_frontier(batch_limit), candidates(batch_limit);
+	std::vector<char> full(batch_limit);
+	std::vector<std::vector<std::pair<float, int>>> heap(batch_limit); // 测地距离生长时每个patch的二叉小根堆
+	std::vector<int> proposal(batch_limit); // 测地距离生长时每个patch本步提名的顶点
+	std::vector<uint64_t> proposal_key(batch_limit);
+
+	int next_seed = 0; // 与串行版本相同的游标，只向前移动
+	for (int round = 0; ; ++round) {
+		// 选取本轮的seed：按曲率顺序，跳过已覆盖的点和已选seed邻域内的点
+		while (next_seed < vertices_num && covered[vertex_rank[next_seed]]) ++next_seed;
+		if (next_seed == vertices_num) break;
+		batch_seed.clear();
+		for (int i = next_seed; i < vertices_num && i < next_seed + scan_limit && batch_seed.size() < batch_limit; ++i) {
+			int candidate = vertex_rank[i];
+			if (covered[candidate] || blocked[candidate] == round) continue;
+			batch_seed.push_back(candidate);
+			blocked[candidate] = round;
+			ball.assign(1, candidate);
+			for (int hop = 0; hop < separation && !ball.empty(); ++hop) {
+				next_ball.clear();
+				for (int vertex : ball) {
+					for (int edge = adjacency_offset[vertex]; edge < adjacency_offset[vertex + 1]; ++edge) {
+						int to_vertex = adjacency_vertex[edge];
+						if (blocked[to_vertex] == round) continue;
+						blocked[to_vertex] = round;
+						next_ball.push_back(to_vertex);
+					}
+				}
+				ball.swap(next_ball);
+			}
+		}
+
+		// 记录新seed，patch号按seed的曲率顺序分配
+		int batch_size = batch_seed.size();
+		int first_patch = patch_vertices.size();
+		for (int slot = 0; slot < batch_size; ++slot) {
+			int seed_id = batch_seed[slot];
+			patch_vertices.push_back({ seed_id });
+			vertex_to_patch[seed_id] = first_patch + slot;
+			covered[seed_id] = true;
+			frontier[slot].assign(1, seed_id);
+			full[slot] = false;
+		}
+
+		if (patch_growth == PatchGrowth::Geodesic) {
+			// 所有patch同步地按测地距离扩展，每步每个patch提名堆顶最近的未覆盖顶点，同样分为提名、认领、清除三步
+			// 认领步骤与其他patch并行，不能读取covered，因此松弛时只检查法线约束，出堆时再跳过已覆盖的顶点
+			auto relax = [&](int slot, int vertex, float distance) {
+				const Eigen::Vector3f& seed_normal = origin_normals->at(batch_seed[slot]);
+				for (int edge = adjacency_offset[vertex]; edge < adjacency_offset[vertex + 1]; ++edge) {
+					int to_vertex = adjacency_vertex[edge];
+					if (seed_normal.dot(origin_normals->at(to_vertex)) <= cos_tolerance) continue;
+					heap[slot].emplace_back(distance + edge_length[edge], to_vertex);
+					std::push_heap(heap[slot].begin(), heap[slot].end(), std::greater<std::pair<float, int>>());
+				}
+			};
+			for (int slot = 0; slot < batch_size; ++slot) {
+				heap[slot].clear();
+				relax(slot, batch_seed[slot], 0.0f);
+			}
+			while (true) {
+				// 提名
+				thread_pool.parallel_for(0, batch_size, [&](int slot, int) {
+					proposal[slot] = -1;
+					if (full[slot]) return;
+					auto& patch_heap = heap[slot];
+					while (!patch_heap.empty() && covered[patch_heap.front().second]) {
+						std::pop_heap(patch_heap.begin(), patch_heap.end(), std::greater<std::pair<float, int>>());
+						patch_heap.pop_back();
+					}
+					if (patch_heap.empty()) return;
+					uint32_t distance_bits;
+					std::memcpy(&distance_bits, &patch_heap.front().first, sizeof(distance_bits)); // 非负浮点数的位模式与大小顺序一致
+					int to_vertex = patch_heap.front().second;
+					uint64_t key = (uint64_t(distance_bits) << 32) | uint64_t(slot);
+					uint64_t current = claim[to_vertex].load(std::memory_order_relaxed);
+					while (key < current && !claim[to_vertex].compare_exchange_weak(current, key, std::memory_order_relaxed));
+					proposal[slot] = to_vertex;
+					proposal_key[slot] = key;
+				});
+				if (std::all_of(proposal.begin(), proposal.begin() + batch_size, [](int vertex) { return vertex < 0; })) break;
+				// 认领：认领失败的顶点已被其他patch覆盖，留在堆中，下一步出堆时跳过
+				thread_pool.parallel_for(0, batch_size, [&](int slot, int) {
+					int to_vertex = proposal[slot];
+					if (to_vertex < 0 || claim[to_vertex].load(std::memory_order_relaxed) != proposal_key[slot]) return;
+					auto& patch_heap = heap[slot];
+					float distance = patch_heap.front().first;
+					std::pop_heap(patch_heap.begin(), patch_heap.end(), std::greater<std::pair<float, int>>());
+					patch_heap.pop_back();
+					int patch_id = first_patch + slot;
+					patch_vertices[patch_id].push_back(to_vertex);
+					vertex_to_patch[to_vertex] = patch_id;
+					covered[to_vertex] = true;
+					if (patch_vertices[patch_id].size() >= patch_size_limit) {
+						full[slot] = true;
+					}
+					else {
+						relax(slot, to_vertex, distance);
+					}
+				});
+				// 清除
+				thread_pool.parallel_for(0, batch_size, [&](int slot, int) {
+					if (proposal[slot] >= 0) {
+						claim[proposal[slot]].store(unclaimed, std::memory_order_relaxed);
+					}
+				});
+			}
+			continue;
+		}
+
+		// 所有patch同步地逐层bfs扩展，每层分为提名、认领、清除三步
+		while (true) {
+			bool active = false;
+			for (int slot = 0; slot < batch_size; ++slot) {
+				active = active || (!full[slot] && !frontier[slot].empty());
+			}
+			if (!active) break;
+
+			// 提名：每个patch把当前层可扩展的顶点记为候选，并尝试用自己的序号认领
+			thread_pool.parallel_for(0, batch_size, [&](int slot, int) {
+				candidates[slot].clear();
+				if (full[slot]) return;
+				const Eigen::Vector3f& seed_normal = origin_normals->at(batch_seed[slot]);
+				for (int vertex : frontier[slot]) {
+					for (int edge = adjacency_offset[vertex]; edge < adjacency_offset[vertex + 1]; ++edge) {
+						int to_vertex = adjacency_vertex[edge];
+						if (covered[to_vertex]) continue;
+						if (seed_normal.dot(origin_normals->at(to_vertex)) <= cos_tolerance) continue; // 对法线方向做约束
+						uint64_t current = claim[to_vertex].load(std::memory_order_relaxed);
+						while (uint64_t(slot) < current && !claim[to_vertex].compare_exchange_weak(current, uint64_t(slot), std::memory_order_relaxed));
+						candidates[slot].push_back(to_vertex);
+					}
+				}
+			});
+			// 认领：按bfs顺序加入认领成功的顶点，直到patch达到规模上限
+			thread_pool.parallel_for(0, batch_size, [&](int slot, int) {
+				next_frontier[slot].clear();
+				int patch_id = first_patch + slot;
+				for (int to_vertex : candidates[slot]) {
+					if (full[slot]) break;
+					if (claim[to_vertex].load(std::memory_order_relaxed) != uint64_t(slot) || covered[to_vertex]) continue;
+					next_frontier[slot].push_back(to_vertex);
+					patch_vertices[patch_id].push_back(to_vertex);
+					vertex_to_patch[to_vertex] = patch_id;
+					covered[to_vertex] = true;
+					if (patch_vertices[patch_id].size() >= patch_size_limit) {
+						full[slot] = true;
+					}
+				}
+				frontier[slot].swap(next_frontier[slot]);
+			});
+			// 清除：未被加入的候选点留给后续的patch
+			thread_pool.parallel_for(0, batch_size, [&](int slot, int) {
+				for (int to_vertex : candidates[slot]) {
+					claim[to_vertex].store(unclaimed, std::memory_order_relaxed);
+				}
+			});
+		}
 	}
 }
 
@@ -206,143 +598,762 @@ Eigen::Matrix4f Compressor::generate_transform(const Eigen::Vector3f& cord, cons
 }
 
 void Compressor::resample() {
+	std::vector<ResampleScratch> scratches;
+	prepare_resample(scratches);
 	Eigen::MatrixXf patch_resample_height = Eigen::MatrixXf::Constant(N_bins * N_bins, patch_num, 0.0f);
+	resample_range(0, patch_num, scratches, patch_resample_height);
+	patch_featuress.push_back(std::move(patch_resample_height));
+}
+
+void Compressor::prepare_resample(std::vector<ResampleScratch>& scratches) {
 	std::vector<std::vector<int>>(patch_num).swap(patch_masks);
 	std::vector<float>(patch_num).swap(patch_grid_span);
 	std::vector<Eigen::Vector2f>(patch_num).swap(patch_seed_bias);
 
-	for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
-		int seed_id = patch_vertices[patch_id][0];
-		std::vector<std::vector<float>> grid_vertex_height(N_bins * N_bins); // 多个顶点可能被采样到同一个网格，用一个映射记录每个网格包含的顶点
-		Eigen::Matrix4f transform = generate_transform(origin_vertices->at(seed_id), origin_normals->at(seed_id));
-
-		// 计算顶点的局部坐标
-		std::vector<Eigen::Vector3f> local_cord_record;
-		float min_x = 0.0f, max_x = 0.0f, min_y = 0.0f, max_y = 0.0f;
-		for (int i = 1; i < patch_vertices[patch_id].size(); ++i) {
-			int point = patch_vertices[patch_id][i];
-			Eigen::Vector4f point_cord = { origin_vertices->at(point)[0], origin_vertices->at(point)[1], origin_vertices->at(point)[2], 1.0f };
-			Eigen::Vector4f local_cord = transform * point_cord;
-			if (local_cord[3] != 0) {
-				local_cord /= local_cord[3]; // 齐次化
-			}
-			local_cord_record.emplace_back(local_cord[0], local_cord[1], local_cord[2]);
-			min_x = std::min(min_x, local_cord[0]);
-			max_x = std::max(max_x, local_cord[0]);
-			min_y = std::min(min_y, local_cord[1]);
-			max_y = std::max(max_y, local_cord[1]);
-		}
-		assert(local_cord_record.size() == patch_vertices[patch_id].size() - 1);
-		
-		// 记录网格重采样的高度
-		Eigen::Vector2f new_grid_origin((min_x + max_x) / 2, (min_y + max_y) / 2);
-		float reach = (max_x - min_x > max_y - min_y) ? (max_x - min_x) : (max_y - min_y);
-		reach = reach * N_bins / (N_bins - 1); // 放缩
-		float span = reach / N_bins;
-		patch_grid_span[patch_id] = span; // 每个patch分别记录网格大小
-		patch_seed_bias[patch_id] = new_grid_origin;
-		float base_x = -reach / 2, base_y = base_x;
-		for (int i = 0; i < local_cord_record.size(); ++i) {
-			float x = local_cord_record[i][0] - new_grid_origin[0];
-			float y = local_cord_record[i][1] - new_grid_origin[1];
-			assert(x > -reach / 2 && x < reach / 2);
-			assert(y > -reach / 2 && y < reach / 2);
-			int x_grid = (x - base_x) / span;
-			int y_grid = (y - base_y) / span;
-			assert(x_grid >= 0 && x_grid < N_bins);
-			assert(y_grid >= 0 && y_grid < N_bins);
-			grid_vertex_height[N_bins * y_grid + x_grid].push_back(local_cord_record[i][2]);
-			// 记录顶点所属的grid
-			int point = patch_vertices[patch_id][i + 1]; // 每个patch的第一个顶点是seed，seed已经记过了，从第二个顶点开始记
-			vertex_to_grid[point] = N_bins * y_grid + x_grid;
-		}
-
-		// 记录grid里所有顶点的平均local高度作为该grid的采样高度
-		for (int grid = 0; grid < N_bins * N_bins; ++grid) {
-			if (!grid_vertex_height[grid].empty()) {
-				float total_height = std::accumulate(grid_vertex_height[grid].begin(), grid_vertex_height[grid].end(), 0.0f);
-				patch_resample_height(grid, patch_id) = total_height / grid_vertex_height[grid].size();
-				patch_masks[patch_id].push_back(grid); // 记录采样到了顶点的网格(这些网格在解压缩时需要还原成对应的顶点)
+	// 每个线程一份重采样缓存，所有patch复用，避免逐patch分配内存
+	std::vector<ResampleScratch>(thread_pool.size()).swap(scratches);
+	for (auto& scratch : scratches) {
+		scratch.grid_height_sum.resize(N_bins * N_bins);
+		scratch.grid_vertex_count.resize(N_bins * N_bins);
+	}
+}
+
+void Compressor::resample_range(int first, int last, std::vector<ResampleScratch>& scratches, Eigen::MatrixXf& height) {
+	// patch之间相互独立，各自写入特征矩阵的不同列
+	dispatch_grid_kernel(N_bins, [&](auto kernel) {
+		thread_pool.parallel_for(first, last, [&](int patch_id, int thread_index) {
+			resample_patch(kernel, patch_id, scratches[thread_index], height.col(patch_id - first).data());
+		}, 16);
+	});
+}
+
+template <typename Kernel>
+void Compressor::resample_patch(const Kernel& kernel, int patch_id, ResampleScratch& scratch, float* height) {
+	int seed_id = patch_vertices[patch_id][0];
+	LocalFrame frame = LocalFrame::from_transform(generate_transform(origin_vertices->at(seed_id), origin_normals->at(seed_id)));
+
+	// 批量计算顶点的局部坐标
+	int n = patch_vertices[patch_id].size() - 1;
+	scratch.x.resize(n);
+	scratch.y.resize(n);
+	scratch.z.resize(n);
+	scratch.grid_index.resize(n);
+	for (int i = 0; i < n; ++i) {
+		const Eigen::Vector3f& point = origin_vertices->at(patch_vertices[patch_id][i + 1]);
+		scratch.x[i] = point[0];
+		scratch.y[i] = point[1];
+		scratch.z[i] = point[2];
+	}
+	transform_points(frame, scratch.x.data(), scratch.y.data(), scratch.z.data(), n, scratch.x.data(), scratch.y.data(), scratch.z.data());
+	float min_x = 0.0f, max_x = 0.0f, min_y = 0.0f, max_y = 0.0f;
+	for (int i = 0; i < n; ++i) {
+		min_x = std::min(min_x, scratch.x[i]);
+		max_x = std::max(max_x, scratch.x[i]);
+		min_y = std::min(min_y, scratch.y[i]);
+		max_y = std::max(max_y, scratch.y[i]);
+	}
+
+	// 记录网格重采样的高度
+	Eigen::Vector2f new_grid_origin((min_x + max_x) / 2, (min_y + max_y) / 2);
+	float reach = (max_x - min_x > max_y - min_y) ? (max_x - min_x) : (max_y - min_y);
+	reach = reach * N_bins / (N_bins - 1); // 放缩
+	float span = reach / N_bins;
+	patch_grid_span[patch_id] = span; // 每个patch分别记录网格大小
+	patch_seed_bias[patch_id] = new_grid_origin;
+	float base = -reach / 2;
+	kernel.grid_index(scratch.x.data(), scratch.y.data(), n, new_grid_origin[0], new_grid_origin[1], base, span, scratch.grid_index.data());
+	for (int i = 0; i < n; ++i) {
+		assert(scratch.grid_index[i] >= 0 && scratch.grid_index[i] < kernel.cells());
+		// 记录顶点所属的grid
+		int point = patch_vertices[patch_id][i + 1]; // 每个patch的第一个顶点是seed，seed已经记过了，从第二个顶点开始记
+		vertex_to_grid[point] = scratch.grid_index[i];
+	}
+
+	// 多个顶点可能被采样到同一个网格，记录grid里所有顶点的平均local高度作为该grid的采样高度
+	// 同时记录采样到了顶点的网格(这些网格在解压缩时需要还原成对应的顶点)
+	// 流式编码会对同一个patch重采样两次，因此先清空掩码
+	patch_masks[patch_id].clear();
+	kernel.average_height(scratch.grid_index.data(), scratch.z.data(), n, scratch.grid_height_sum.data(), scratch.grid_vertex_count.data(),
+		height, patch_masks[patch_id]);
+}
+
+bool Compressor::set_shared_dictionary(const Eigen::MatrixXf& dictionary, uint64_t hash) {
+	if (dictionary.rows() != N_bins * N_bins) {
+		std::cout << "ERROR: 共享字典的特征长度与N_bins不一致" << std::endl;
+		return false;
+	}
+	shared_dictionary = dictionary;
+	shared_dictionary_hash = hash;
+	if (clusters > 1 || sparsity > 0) {
+		std::cout << "LOG: 使用共享字典时不进行聚类和稀疏编码" << std::endl;
+		clusters = 1;
+		sparsity = 0;
+	}
+	return true;
+}
+
+int Compressor::accumulate_training_gram(Eigen::MatrixXd& gram) {
+	EigenThreadScope eigen_threads(deterministic);
+	if (patch_vertices.size() == 0) generate_patches();
+	resample();
+	accumulate_gram(patch_featuress[0], gram);
+	std::vector<Eigen::MatrixXf>().swap(patch_featuress);
+	return patch_num;
+}
+
+void Compressor::cluster_features() {
+	// 用k-means把patch特征分为clusters类，每类单独求字典，分类越细每类所需的算子越少
+	const Eigen::MatrixXf& feature = patch_featuress[0];
+	const int rows = feature.rows();
+	const int k = std::min(clusters, patch_num);
+	const int block = 1024;
+
+	// k-means++初始化，随机数使用固定种子，保证结果可复现
+	std::mt19937 generator(0);
+	Eigen::MatrixXf centroid(rows, k);
+	centroid.col(0) = feature.col(std::uniform_int_distribution<int>(0, patch_num - 1)(generator));
+	std::vector<double> nearest(patch_num, std::numeric_limits<double>::max()); // 到已选中心的最小距离平方
+	for (int c = 1; c < k; ++c) {
+		thread_pool.parallel_for(0, patch_num, [&](int i, int) {
+			nearest[i] = std::min(nearest[i], double((feature.col(i) - centroid.col(c - 1)).squaredNorm()));
+		}, block);
+		// 按距离平方的比例随机选取下一个中心
+		double target = std::uniform_real_distribution<double>(0.0, std::accumulate(nearest.begin(), nearest.end(), 0.0))(generator);
+		int chosen = 0;
+		for (double sum = nearest[0]; chosen < patch_num - 1 && sum < target; sum += nearest[++chosen]);
+		centroid.col(c) = feature.col(chosen);
+	}
+
+	// Lloyd迭代
+	std::vector<int>(patch_num, -1).swap(patch_cluster);
+	int iteration = 0;
+	while (iteration < cluster_iterations) {
+		++iteration;
+		// 分配：||x - c||^2 = ||x||^2 - 2 * x·c + ||c||^2，||x||^2对所有中心相同，只需比较后两项，分块用矩阵乘法计算
+		Eigen::VectorXf centroid_norm = centroid.colwise().squaredNorm().transpose();
+		std::atomic<int> changed{ 0 };
+		thread_pool.parallel_for(0, (patch_num + block - 1) / block, [&](int b, int) {
+			int first = b * block, count = std::min(block, patch_num - first);
+			Eigen::MatrixXf distance = (-2.0f * (centroid.transpose() * feature.middleCols(first, count))).colwise() + centroid_norm;
+			for (int i = 0; i < count; ++i) {
+				int best;
+				distance.col(i).minCoeff(&best);
+				if (patch_cluster[first + i] != best) {
+					patch_cluster[first + i] = best;
+					changed.fetch_add(1);
+				}
+			}
+		});
+		if (changed.load() == 0) break;
+		// 更新：按固定分块归约求各类均值，结果与线程数无关
+		using Sums = std::pair<Eigen::MatrixXd, Eigen::VectorXi>;
+		Sums zero(Eigen::MatrixXd::Zero(rows, k), Eigen::VectorXi::Zero(k));
+		Sums sums = thread_pool.parallel_reduce(0, patch_num, block, zero,
+			[&](int first, int last) -> Sums {
+				Sums partial(Eigen::MatrixXd::Zero(rows, k), Eigen::VectorXi::Zero(k));
+				for (int i = first; i < last; ++i) {
+					partial.first.col(patch_cluster[i]) += feature.col(i).cast<double>();
+					partial.second[patch_cluster[i]] += 1;
+				}
+				return partial;
+			},
+			[](Sums total, const Sums& partial) -> Sums {
+				total.first += partial.first;
+				total.second += partial.second;
+				return total;
+			});
+		for (int c = 0; c < k; ++c) {
+			if (sums.second[c] > 0) { // 空类保留原中心
+				centroid.col(c) = (sums.first.col(c) / sums.second[c]).cast<float>();
 			}
 		}
 	}
-	patch_featuress.push_back(std::move(patch_resample_height));
+
+	// 去掉空类并重新编号，按聚类拆分特征矩阵，聚类内按patch号升序排列
+	std::vector<std::vector<int>> members(k);
+	for (int i = 0; i < patch_num; ++i) {
+		members[patch_cluster[i]].push_back(i);
+	}
+	members.erase(std::remove_if(members.begin(), members.end(), [](const std::vector<int>& m) { return m.empty(); }), members.end());
+	std::vector<Eigen::MatrixXf> features(members.size());
+	for (int c = 0; c < members.size(); ++c) {
+		features[c].resize(rows, members[c].size());
+		for (int j = 0; j < members[c].size(); ++j) {
+			patch_cluster[members[c][j]] = c;
+			features[c].col(j) = feature.col(members[c][j]);
+		}
+	}
+	patch_featuress.swap(features);
+
+	auto [smallest, largest] = std::minmax_element(members.begin(), members.end(),
+		[](const std::vector<int>& a, const std::vector<int>& b) { return a.size() < b.size(); });
+	std::cout << "LOG: k-means迭代" << iteration << "次，得到" << members.size() << "个聚类，聚类大小"
+		<< smallest->size() << "~" << largest->size() << std::endl;
 }
 
 void Compressor::coding(const Eigen::MatrixXf& feature, Eigen::MatrixXf& dictionary, Eigen::MatrixXf& code, int _atoms) {
+	_atoms = adjust_atoms(_atoms, feature.rows(), feature.cols());
+
+	if (svd_backend == SvdBackend::Gram) {
+		// F = U * S * V^T，则F * F^T = U * S^2 * U^T，对行数×行数的Gram矩阵做特征值分解即可得到U，编码U^T * F = S * V^T
+		Eigen::MatrixXd gram = Eigen::MatrixXd::Zero(feature.rows(), feature.rows());
+		accumulate_gram(feature, gram);
+		dictionary = gram_dictionary(gram, _atoms, double(feature.size()));
+		code = dictionary.transpose() * feature;
+		return;
+	}
+	if (svd_backend == SvdBackend::Randomized) {
+		randomized_coding(feature, dictionary, code, _atoms);
+		return;
+	}
+
+	// 使用SVD分解，得到字典和编码
+	auto clip = [&](const auto& svd) {
+		Eigen::VectorXf S = svd.singularValues();
+		Eigen::VectorXd energy = S.cast<double>().array().square();
+		_atoms = select_atoms(energy, energy.sum(), double(feature.size()), _atoms);
+		Eigen::MatrixXf clipU = svd.matrixU()(Eigen::all, Eigen::seqN(0, _atoms)); // 前atoms列
+		Eigen::MatrixXf clipV = svd.matrixV()(Eigen::all, Eigen::seqN(0, _atoms)); // 前atoms行(注意后面有转置操作，因此这里取前atoms列)
+		Eigen::MatrixXf diagS = Eigen::MatrixXf::Identity(_atoms, _atoms);
+		diagS.diagonal(0) = S(Eigen::seqN(0, _atoms)); // diagS的主对角线是前atoms个奇异值，已经按照从大到小排列
+		dictionary = clipU;
+
+		code = diagS * clipV.transpose(); // 与np.linalg.svd不同，Eigen的V是转置之前的，使用时需转置
+	};
+	if (svd_backend == SvdBackend::BDC) {
+		clip(Eigen::BDCSVD<Eigen::MatrixXf>(feature, Eigen::ComputeThinU | Eigen::ComputeThinV));
+	}
+	else {
+		clip(Eigen::JacobiSVD<Eigen::MatrixXf>(feature, Eigen::ComputeThinU | Eigen::ComputeThinV));
+	}
+}
+
+void Compressor::masked_coding(const Eigen::MatrixXf& feature, const std::vector<int>& column_patch, Eigen::MatrixXf& dictionary, Eigen::MatrixXf& code) {
+	// 没有顶点的网格高度为0，并不是真实数据，只用有顶点的网格拟合：min sum_(i,j)∈mask (F_ij - D_i * c_j)^2
+	const int rows = feature.rows(), cols = feature.cols(), atoms = dictionary.cols();
+	const float ridge = 1e-4f; // 有值网格少于算子数的patch方程欠定，加正则项保证可解
+	// 按行转置掩码，得到每个网格在哪些列中有值，CSR格式
+	std::vector<int> row_offset(rows + 1, 0), row_column;
+	for (int j = 0; j < cols; ++j) {
+		for (int grid : patch_masks[column_patch[j]]) {
+			++row_offset[grid + 1];
+		}
+	}
+	for (int i = 0; i < rows; ++i) {
+		row_offset[i + 1] += row_offset[i];
+	}
+	row_column.resize(row_offset[rows]);
+	std::vector<int> cursor(row_offset.begin(), row_offset.end() - 1);
+	for (int j = 0; j < cols; ++j) {
+		for (int grid : patch_masks[column_patch[j]]) {
+			row_column[cursor[grid]++] = j;
+		}
+	}
+	// 有值网格上的均方根误差
+	std::vector<double> squared_error(cols);
+	auto masked_rms = [&]() {
+		thread_pool.parallel_for(0, cols, [&](int j, int) {
+			double sum = 0.0;
+			for (int grid : patch_masks[column_patch[j]]) {
+				double difference = feature(grid, j) - dictionary.row(grid).dot(code.col(j));
+				sum += difference * difference;
+			}
+			squared_error[j] = sum;
+		}, 256);
+		return std::sqrt(std::accumulate(squared_error.begin(), squared_error.end(), 0.0) / std::max(row_offset[rows], 1));
+	};
+
+	double initial_error = masked_rms();
+	for (int iteration = 0; iteration < masked_iterations; ++iteration) {
+		// 固定字典，各列只用有值的行求解编码
+		thread_pool.parallel_for(0, cols, [&](int j, int) {
+			const auto& mask = patch_masks[column_patch[j]];
+			Eigen::MatrixXf normal = ridge * Eigen::MatrixXf::Identity(atoms, atoms);
+			Eigen::VectorXf rhs = Eigen::VectorXf::Zero(atoms);
+			for (int grid : mask) {
+				normal.selfadjointView<Eigen::Lower>().rankUpdate(dictionary.row(grid).transpose());
+				rhs += feature(grid, j) * dictionary.row(grid).transpose();
+			}
+			code.col(j) = normal.selfadjointView<Eigen::Lower>().llt().solve(rhs);
+		}, 256);
+		// 固定编码，各行只用有值的列求解字典
+		thread_pool.parallel_for(0, rows, [&](int i, int) {
+			Eigen::MatrixXf normal = ridge * Eigen::MatrixXf::Identity(atoms, atoms);
+			Eigen::VectorXf rhs = Eigen::VectorXf::Zero(atoms);
+			for (int k = row_offset[i]; k < row_offset[i + 1]; ++k) {
+				int j = row_column[k];
+				normal.selfadjointView<Eigen::Lower>().rankUpdate(code.col(j));
+				rhs += feature(i, j) * code.col(j);
+			}
+			dictionary.row(i) = normal.selfadjointView<Eigen::Lower>().llt().solve(rhs).transpose();
+		});
+		if (verbose) {
+			std::cout << "LOG: 掩码加权ALS第" + std::to_string(iteration) + "次迭代，有值网格的均方根误差 " + std::to_string(masked_rms()) + "\n";
+		}
+	}
+	std::ostringstream message; // 多个聚类并行编码时整行输出，避免日志交错
+	message << "LOG: 掩码加权ALS，有值网格的均方根误差 " << initial_error << " -> " << masked_rms() << std::endl;
+	std::cout << message.str();
+}
+
+void Compressor::sparse_coding(const Eigen::MatrixXf& feature, Eigen::MatrixXf& dictionary, SparseCode& code) {
+	const int rows = feature.rows(), cols = feature.cols();
+	const int atoms = std::max(sparse_atoms, 1);
+	std::mt19937 generator(0); // 固定种子，保证结果可复现
+	// 用随机选取的单位化特征列替换字典中不可用的原子
+	auto random_atom = [&]() -> Eigen::VectorXf {
+		for (int attempt = 0; attempt < 16; ++attempt) {
+			Eigen::VectorXf column = feature.col(std::uniform_int_distribution<int>(0, cols - 1)(generator));
+			if (column.norm() > 1e-6f) return column.normalized();
+		}
+		std::normal_distribution<float> gaussian(0.0f, 1.0f);
+		Eigen::VectorXf column(rows);
+		for (int i = 0; i < rows; ++i) {
+			column[i] = gaussian(generator);
+		}
+		return column.normalized();
+	};
+
+	// 初始字典：前面是Gram矩阵的特征向量(即SVD的主方向)，其余为随机选取的特征列
+	Eigen::MatrixXd gram = Eigen::MatrixXd::Zero(rows, rows);
+	accumulate_gram(feature, gram);
+	Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(gram);
+	int principal = std::min({ atoms, rows, cols });
+	dictionary.resize(rows, atoms);
+	dictionary.leftCols(principal) = eigen_solver.eigenvectors().rightCols(principal).rowwise().reverse().cast<float>();
+	for (int k = principal; k < atoms; ++k) {
+		dictionary.col(k) = random_atom();
+	}
+
+	// MOD：固定编码C，字典取最小二乘解D = F * C^T * (C * C^T)^-1
+	const int block = 4096;
+	for (int iteration = 0; iteration < sparse_iterations; ++iteration) {
+		double rms_error = sparse_pursuit(feature, dictionary, code);
+		if (verbose) {
+			std::cout << "LOG: 稀疏编码第" + std::to_string(iteration) + "次迭代，均方根误差 " + std::to_string(rms_error) + "\n";
+		}
+		using Sums = std::pair<Eigen::MatrixXd, Eigen::MatrixXd>; // F * C^T, C * C^T
+		Sums zero(Eigen::MatrixXd::Zero(rows, atoms), Eigen::MatrixXd::Zero(atoms, atoms));
+		Sums sums = thread_pool.parallel_reduce(0, cols, block, zero,
+			[&](int first, int last) -> Sums {
+				Sums partial(Eigen::MatrixXd::Zero(rows, atoms), Eigen::MatrixXd::Zero(atoms, atoms));
+				for (int j = first; j < last; ++j) {
+					Eigen::VectorXd x = feature.col(j).cast<double>();
+					for (int a = code.offset[j]; a < code.offset[j + 1]; ++a) {
+						partial.first.col(code.index[a]) += double(code.value[a]) * x;
+						for (int b = code.offset[j]; b < code.offset[j + 1]; ++b) {
+							partial.second(code.index[a], code.index[b]) += double(code.value[a]) * code.value[b];
+						}
+					}
+				}
+				return partial;
+			},
+			[](Sums total, const Sums& partial) -> Sums {
+				total.first += partial.first;
+				total.second += partial.second;
+				return total;
+			});
+		// 加很小的正则项，未被使用的原子解为0，随后重新初始化
+		sums.second.diagonal().array() += 1e-9 * std::max(sums.second.trace(), 1.0);
+		Eigen::MatrixXf updated = sums.second.ldlt().solve(sums.first.transpose()).transpose().cast<float>();
+		for (int k = 0; k < atoms; ++k) {
+			float norm = updated.col(k).norm();
+			dictionary.col(k) = norm > 1e-6f ? Eigen::VectorXf(updated.col(k) / norm) : random_atom();
+		}
+	}
+	double rms_error = sparse_pursuit(feature, dictionary, code);
+	std::ostringstream message; // 多个聚类并行编码时整行输出，避免日志交错
+	message << "LOG: 稀疏编码字典原子数 " << atoms << "，平均非零项数 " << double(code.index.size()) / std::max(cols, 1)
+		<< "，均方根误差 " << rms_error << std::endl;
+	std::cout << message.str();
+}
+
+double Compressor::sparse_pursuit(const Eigen::MatrixXf& feature, const Eigen::MatrixXf& dictionary, SparseCode& code) {
+	const int cols = feature.cols();
+	const int max_nonzeros = std::min({ sparsity, int(dictionary.cols()), int(feature.rows()) });
+	const int block = 256;
+	// 每列最多max_nonzeros个非零项，先写入定长的槽位，再压缩为CSR
+	Eigen::MatrixXf gram = dictionary.transpose() * dictionary;
+	std::vector<int> count(cols), slot_index(size_t(cols) * max_nonzeros);
+	std::vector<float> slot_value(size_t(cols) * max_nonzeros);
+	std::vector<double> squared_error(cols);
+	thread_pool.parallel_for(0, (cols + block - 1) / block, [&](int b, int) {
+		int first = b * block, n = std::min(block, cols - first);
+		Eigen::MatrixXf alpha0 = dictionary.transpose() * feature.middleCols(first, n);
+		std::vector<int> index;
+		std::vector<float> value;
+		for (int i = 0; i < n; ++i) {
+			int j = first + i;
+			index.clear();
+			value.clear();
+			batch_omp(gram, alpha0.col(i), max_nonzeros, index, value);
+			count[j] = index.size();
+			Eigen::VectorXf residual = feature.col(j);
+			for (int k = 0; k < index.size(); ++k) {
+				slot_index[size_t(j) * max_nonzeros + k] = index[k];
+				slot_value[size_t(j) * max_nonzeros + k] = value[k];
+				residual -= value[k] * dictionary.col(index[k]);
+			}
+			squared_error[j] = residual.squaredNorm();
+		}
+	});
+	code.offset.assign(cols + 1, 0);
+	for (int j = 0; j < cols; ++j) {
+		code.offset[j + 1] = code.offset[j] + count[j];
+	}
+	code.index.resize(code.offset[cols]);
+	code.value.resize(code.offset[cols]);
+	for (int j = 0; j < cols; ++j) {
+		std::copy_n(&slot_index[size_t(j) * max_nonzeros], count[j], code.index.begin() + code.offset[j]);
+		std::copy_n(&slot_value[size_t(j) * max_nonzeros], count[j], code.value.begin() + code.offset[j]);
+	}
+	double total = std::accumulate(squared_error.begin(), squared_error.end(), 0.0);
+	return std::sqrt(total / std::max(double(feature.size()), 1.0));
+}
+
+void Compressor::batch_omp(const Eigen::MatrixXf& gram, const Eigen::VectorXf& alpha0, int max_nonzeros,
+	std::vector<int>& index, std::vector<float>& value) {
+	// Batch OMP(Rubinstein等)：只用D^T * x和D^T * D迭代，选中原子的最小二乘解通过逐步扩展的Cholesky分解求得
+	Eigen::VectorXf alpha = alpha0; // 残差与各原子的内积D^T * r
+	Eigen::MatrixXf L = Eigen::MatrixXf::Zero(max_nonzeros, max_nonzeros); // 选中原子的Gram子矩阵的Cholesky因子
+	Eigen::VectorXf gamma;
+	int first = index.size();
+	for (int j = 0; j < max_nonzeros; ++j) {
+		int k;
+		if (alpha.cwiseAbs().maxCoeff(&k) <= 1e-7f) break; // 残差已经为0
+		if (j > 0) {
+			Eigen::VectorXf g(j);
+			for (int t = 0; t < j; ++t) {
+				g[t] = gram(index[first + t], k);
+			}
+			Eigen::VectorXf w = L.topLeftCorner(j, j).triangularView<Eigen::Lower>().solve(g);
+			float diagonal = 1.0f - w.squaredNorm();
+			if (diagonal <= 1e-6f) break; // 与已选原子线性相关
+			L.row(j).head(j) = w.transpose();
+			L(j, j) = std::sqrt(diagonal);
+		}
+		else {
+			L(0, 0) = 1.0f;
+		}
+		index.push_back(k);
+		// 求解L * L^T * gamma = alpha0_I，再更新alpha = alpha0 - G_I * gamma
+		Eigen::VectorXf rhs(j + 1);
+		for (int t = 0; t <= j; ++t) {
+			rhs[t] = alpha0[index[first + t]];
+		}
+		auto lower = L.topLeftCorner(j + 1, j + 1).triangularView<Eigen::Lower>();
+		gamma = lower.transpose().solve(lower.solve(rhs));
+		alpha = alpha0;
+		for (int t = 0; t <= j; ++t) {
+			alpha -= gamma[t] * gram.col(index[first + t]);
+		}
+	}
+	for (int t = 0; t < int(index.size()) - first; ++t) {
+		value.push_back(gamma[t]);
+	}
+}
+
+void Compressor::randomized_coding(const Eigen::MatrixXf& feature, Eigen::MatrixXf& dictionary, Eigen::MatrixXf& code, int _atoms) {
+	// Halko等的随机值域求解：Y = F * Omega近似张成F的前atoms个左奇异向量，幂迭代使小奇异值衰减得更快
+	const int block = 4096;
+	const int rows = feature.rows(), cols = feature.cols();
+	const int samples = std::min(_atoms + std::max(svd_oversampling, 0), std::min(rows, cols));
+	// F * X，按固定的列块并行累加，X的行数为cols
+	auto multiply = [&](const Eigen::MatrixXf& X) -> Eigen::MatrixXf {
+		Eigen::MatrixXf zero = Eigen::MatrixXf::Zero(rows, X.cols());
+		return thread_pool.parallel_reduce(0, cols, block, zero,
+			[&](int first, int last) -> Eigen::MatrixXf {
+				return feature.middleCols(first, last - first) * X.middleRows(first, last - first);
+			},
+			[](Eigen::MatrixXf total, const Eigen::MatrixXf& partial) -> Eigen::MatrixXf {
+				return total + partial;
+			});
+	};
+	// F^T * X，各列块写入结果的不同行
+	auto multiply_transpose = [&](const Eigen::MatrixXf& X) -> Eigen::MatrixXf {
+		Eigen::MatrixXf result(cols, X.cols());
+		thread_pool.parallel_for(0, (cols + block - 1) / block, [&](int i, int) {
+			int first = i * block, count = std::min(block, cols - first);
+			result.middleRows(first, count).noalias() = feature.middleCols(first, count).transpose() * X;
+		});
+		return result;
+	};
+	// 列正交化
+	auto orthonormalize = [](const Eigen::MatrixXf& Y) -> Eigen::MatrixXf {
+		Eigen::HouseholderQR<Eigen::MatrixXf> qr(Y);
+		return qr.householderQ() * Eigen::MatrixXf::Identity(Y.rows(), Y.cols());
+	};
+
+	// 高斯随机矩阵使用固定种子，保证结果可复现
+	std::mt19937 generator(0);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+	Eigen::MatrixXf omega(cols, samples);
+	for (int j = 0; j < samples; ++j) {
+		for (int i = 0; i < cols; ++i) {
+			omega(i, j) = gaussian(generator);
+		}
+	}
+	Eigen::MatrixXf Q = orthonormalize(multiply(omega));
+	for (int iteration = 0; iteration < svd_power_iterations; ++iteration) {
+		Q = orthonormalize(multiply(orthonormalize(multiply_transpose(Q))));
+	}
+
+	// B^T = F^T * Q，B的奇异向量经Q映射回原空间即为F的近似奇异向量
+	Eigen::JacobiSVD<Eigen::MatrixXf> svd(multiply_transpose(Q), Eigen::ComputeThinV);
+	// 近似奇异值只覆盖前samples个，剩余能量由F的总能量减去已覆盖的部分得到
+	Eigen::VectorXd energy = svd.singularValues().head(_atoms).cast<double>().array().square();
+	_atoms = select_atoms(energy, feature.cast<double>().squaredNorm(), double(feature.size()), _atoms);
+	dictionary = Q * svd.matrixV().leftCols(_atoms);
+	code = multiply_transpose(dictionary).transpose();
+
+	if (verbose) {
+		// 与精确分解的奇异值对比
+		Eigen::VectorXf exact = Eigen::BDCSVD<Eigen::MatrixXf>(feature).singularValues().head(_atoms);
+		Eigen::VectorXf approx = svd.singularValues().head(_atoms);
+		float max_error = 0.0f;
+		for (int i = 0; i < _atoms; ++i) {
+			if (exact[i] > 0.0f) {
+				max_error = std::max(max_error, std::abs(approx[i] - exact[i]) / exact[i]);
+			}
+		}
+		std::ostringstream message; // 多个聚类并行编码时整行输出，避免日志交错
+		message << "LOG: 随机SVD采样" << samples << "列，前" << _atoms << "个奇异值的最大相对误差 " << max_error
+			<< "，第" << _atoms << "个奇异值 " << approx[_atoms - 1] << "(精确值 " << exact[_atoms - 1] << ")" << std::endl;
+		std::cout << message.str();
+	}
+}
+
+int Compressor::adjust_atoms(int _atoms, int rows, int cols) {
 	// 默认值
 	int new_atoms = _atoms;
 	if (new_atoms <= 0) {
-		new_atoms = feature.cols();
+		new_atoms = cols;
 	}
-	// 使用SVD分解，得到字典和编码
-	Eigen::JacobiSVD<Eigen::MatrixXf> svd(feature, Eigen::ComputeThinU | Eigen::ComputeThinV);
-	Eigen::VectorXf S = svd.singularValues();
-	if (new_atoms > svd.matrixU().cols()) {
-		new_atoms = svd.matrixU().cols();
+	int rank = std::min(rows, cols); // 薄SVD的奇异值个数
+	if (new_atoms > rank) {
+		new_atoms = rank;
 	}
 	if (new_atoms != _atoms) {
-		std::cout << "LOG: 算子数量重新调整为" << new_atoms << std::endl;
-		_atoms = new_atoms;
+		std::cout << "LOG: 算子数量重新调整为" + std::to_string(new_atoms) + "\n";
 	}
-	Eigen::MatrixXf clipU = svd.matrixU()(Eigen::all, Eigen::seqN(0, _atoms)); // 前atoms列
-	Eigen::MatrixXf clipV = svd.matrixV()(Eigen::all, Eigen::seqN(0, _atoms)); // 前atoms行(注意后面有转置操作，因此这里取前atoms列)
-	Eigen::MatrixXf diagS = Eigen::MatrixXf::Identity(_atoms, _atoms);
-	diagS.diagonal(0) = S(Eigen::seqN(0, _atoms)); // diagS的主对角线是前atoms个奇异值，已经按照从大到小排列
-	dictionary = clipU;
+	return new_atoms;
+}
 
-	code = diagS * clipV.transpose(); // 与np.linalg.svd不同，Eigen::JacobiSVD的V是转置之前的，使用时需转置
+void Compressor::accumulate_gram(const Eigen::Ref<const Eigen::MatrixXf>& feature, Eigen::MatrixXd& gram) {
+	// 按固定的列块并行累加F * F^T，块的划分与线程数无关，用double累加避免丢失小奇异值的精度
+	// 已有的gram作为归约初值，各块按顺序加在其后，因此分块调用时只要块边界对齐，结果与一次性累加逐位一致
+	const int block = 4096;
+	gram = thread_pool.parallel_reduce(0, int(feature.cols()), block, gram,
+		[&](int first, int last) -> Eigen::MatrixXd {
+			Eigen::MatrixXd columns = feature.middleCols(first, last - first).cast<double>();
+			Eigen::MatrixXd partial = Eigen::MatrixXd::Zero(feature.rows(), feature.rows());
+			partial.selfadjointView<Eigen::Lower>().rankUpdate(columns);
+			return partial.selfadjointView<Eigen::Lower>();
+		},
+		[](Eigen::MatrixXd total, const Eigen::MatrixXd& partial) -> Eigen::MatrixXd {
+			return total + partial;
+		});
 }
 
-void Compressor::record_connection() {
-	auto comp = [](const std::vector<int>& a, const std::vector<int>& b) -> bool {
-		return a[0] == b[0] ? a[1] < b[1] : a[0] < b[0];
+Eigen::MatrixXf Compressor::gram_dictionary(const Eigen::MatrixXd& gram, int _atoms, double elements) {
+	Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(gram);
+	// Gram矩阵的特征值即奇异值的平方，舍入误差可能使其略小于0
+	Eigen::VectorXd energy = eigen_solver.eigenvalues().reverse().cwiseMax(0.0);
+	_atoms = select_atoms(energy, gram.trace(), elements, _atoms);
+	// 特征值按升序排列，取最大的atoms个并倒序，使字典的列按奇异值从大到小排列
+	return eigen_solver.eigenvectors().rightCols(_atoms).rowwise().reverse().cast<float>();
+}
+
+int Compressor::select_atoms(const Eigen::VectorXd& energy, double total_energy, double elements, int _atoms) {
+	// 舍弃第k个之后的奇异值时，重建误差的平方和等于被舍弃的奇异值平方和
+	auto residual = [&](int k) {
+		return std::max(total_energy - energy.head(k).sum(), 0.0);
 	};
+	auto satisfied = [&](int k) {
+		double rest = residual(k);
+		bool rms_ok = target_rms_error <= 0.0f || std::sqrt(rest / elements) <= target_rms_error;
+		bool energy_ok = target_energy <= 0.0f || total_energy <= 0.0 || 1.0 - rest / total_energy >= target_energy;
+		return rms_ok && energy_ok;
+	};
+	int limit = std::min<int>(_atoms, energy.size());
+	int chosen = limit;
+	if (target_rms_error > 0.0f || target_energy > 0.0f) {
+		chosen = 1;
+		while (chosen < limit && !satisfied(chosen)) {
+			++chosen;
+		}
+		if (!satisfied(chosen)) {
+			std::cout << "LOG: " + std::to_string(limit) + "个算子仍未达到误差目标\n";
+		}
+	}
+	double rest = residual(chosen);
+	std::ostringstream message; // 多个聚类并行编码时整行输出，避免日志交错
+	message << "LOG: 算子数 " << chosen << "，预测均方根误差 " << std::sqrt(rest / elements)
+		<< "，保留能量占比 " << (total_energy > 0.0 ? 1.0 - rest / total_energy : 1.0) << std::endl;
+	std::cout << message.str();
+	return chosen;
+}
 
-	std::vector<std::set<std::vector<int>>>(patch_num).swap(patch_faces);
-	std::vector<std::vector<int>>(patch_num).swap(patch_origin_faces);
-	std::vector<std::set<std::vector<int>>>(patch_num).swap(bi_crackfaces);
-	for (int i = 0; i < origin_faces->size(); ++i) {
-		int v0 = origin_faces->at(i)[0];
-		int v1 = origin_faces->at(i)[1];
-		int v2 = origin_faces->at(i)[2];
-
-		std::vector<std::vector<int>> patch_grid = {
-			{ vertex_to_patch[v0], vertex_to_grid[v0] },
-			{ vertex_to_patch[v1], vertex_to_grid[v1] },
-			{ vertex_to_patch[v2], vertex_to_grid[v2] }
-		};
+void Compressor::streaming_coding(int _atoms) {
+	// 按配置的块大小分块，accumulate_gram在每块内按固定的列块累加，结果与线程数无关；
+	// 块大小是4096的整数倍时累加顺序与一次性编码相同，两种方式的结果逐位一致。只因使用共享字典而走到这里时不分块
+	int chunk = coding_chunk > 0 ? coding_chunk : std::max(patch_num, 1);
+	int rows = N_bins * N_bins;
+	if (coding_chunk > 0) {
+		std::cout << "LOG: 流式编码每块 " << chunk << " 个patch" << std::endl;
+		// 编码矩阵(atoms × patch数)仍完整保存，保留全部N_bins²个原子时与特征矩阵一样大，因此atoms <= 0时只保留N_bins² / 4个
+		if (_atoms <= 0) {
+			_atoms = std::max(rows / 4, 1);
+			std::cout << "LOG: 流式编码未指定atoms，算子数上限取" << _atoms << std::endl;
+		}
+	}
+	std::vector<ResampleScratch> scratches;
+	prepare_resample(scratches);
+	Eigen::MatrixXf height(rows, std::min(chunk, patch_num));
+
+	// 第一遍：重采样并累加Gram矩阵，同时记录掩码、网格尺寸、偏移和顶点所属的grid
+	Eigen::MatrixXf dictionary;
+	if (shared_dictionary.size() > 0) {
+		_atoms = adjust_atoms(_atoms, rows, shared_dictionary.cols());
+		dictionary = shared_dictionary.leftCols(_atoms);
+	}
+	else {
+		Eigen::MatrixXd gram = Eigen::MatrixXd::Zero(rows, rows);
+		for (int first = 0; first < patch_num; first += chunk) {
+			int count = std::min(chunk, patch_num - first);
+			height.leftCols(count).setZero();
+			resample_range(first, first + count, scratches, height);
+			accumulate_gram(height.leftCols(count), gram);
+		}
+		_atoms = adjust_atoms(_atoms, rows, patch_num);
+		dictionary = gram_dictionary(gram, _atoms, double(rows) * patch_num);
+		_atoms = dictionary.cols();
+	}
+
+	// 第二遍：重新采样，投影得到编码
+	Eigen::MatrixXf code(_atoms, patch_num);
+	double residual = 0.0; // 字典的列是单位正交的，投影的误差平方和为||F||^2 - ||D^T * F||^2
+	for (int first = 0; first < patch_num; first += chunk) {
+		int count = std::min(chunk, patch_num - first);
+		height.leftCols(count).setZero();
+		resample_range(first, first + count, scratches, height);
+		code.middleCols(first, count).noalias() = dictionary.transpose() * height.leftCols(count);
+		residual += height.leftCols(count).cast<double>().squaredNorm() - code.middleCols(first, count).cast<double>().squaredNorm();
+	}
+	if (shared_dictionary.size() > 0) {
+		std::cout << "LOG: 使用共享字典投影，算子数 " << _atoms << "，均方根误差 "
+			<< std::sqrt(std::max(residual, 0.0) / (double(rows) * patch_num)) << std::endl;
+	}
+	patch_atoms.push_back(_atoms);
+	patch_dictionaries.push_back(std::move(dictionary));
+	patch_codes.push_back(std::move(code));
+}
+
+// 连接性的键：patch号 << 32 | (grid号 + 1)，seed的grid号为-1
+static inline uint64_t pack_patch_grid(int patch, int grid) {
+	return uint64_t(uint32_t(patch)) << 32 | uint32_t(grid + 1);
+}
+static inline int key_patch(uint64_t key) { return int(key >> 32); }
+static inline int key_grid(uint64_t key) { return int(uint32_t(key)) - 1; }
 
-		sort(patch_grid.begin(), patch_grid.end(), comp);
+void Compressor::record_connection() {
+	// 每个面的类别：0为patch内的面，1为两个顶点属于相同patch的缝隙面，2为三个顶点属于不同patch的缝隙面，3为不需要记录的退化面
+	int face_num = int(origin_faces->size());
+	std::vector<char> face_type(face_num);
+	std::vector<std::array<uint64_t, 3>> face_key(face_num);
+	thread_pool.parallel_for(0, face_num, [&](int i, int) {
+		const auto& face = origin_faces->at(i);
+		uint64_t k0 = pack_patch_grid(vertex_to_patch[face[0]], vertex_to_grid[face[0]]);
+		uint64_t k1 = pack_patch_grid(vertex_to_patch[face[1]], vertex_to_grid[face[1]]);
+		uint64_t k2 = pack_patch_grid(vertex_to_patch[face[2]], vertex_to_grid[face[2]]);
+		if (k0 > k1) std::swap(k0, k1);
+		if (k1 > k2) std::swap(k1, k2);
+		if (k0 > k1) std::swap(k0, k1);
 
-		int patch0 = patch_grid[0][0], grid0 = patch_grid[0][1]; // 已经排好序
-		int patch1 = patch_grid[1][0], grid1 = patch_grid[1][1];
-		int patch2 = patch_grid[2][0], grid2 = patch_grid[2][1];
+		int patch0 = key_patch(k0), grid0 = key_grid(k0); // 已经排好序
+		int patch1 = key_patch(k1), grid1 = key_grid(k1);
+		int patch2 = key_patch(k2), grid2 = key_grid(k2);
 
+		auto& key = face_key[i];
 		if (patch0 == patch1 && patch0 == patch2) { // 三个顶点属于同一个patch
-			patch_origin_faces[patch0].push_back(i);
 			if (grid0 != grid1 && grid0 != grid2 && grid1 != grid2) { // 三个顶点分属不同网格
-				patch_faces[patch0].insert({ grid0, grid1, grid2 });
+				face_type[i] = 0;
+				key = { k0, uint64_t(uint32_t(grid1 + 1)) << 32 | uint32_t(grid2 + 1), 0 };
+			}
+			else {
+				face_type[i] = 3;
 			}
 		}
 		else if (patch0 != patch1 && patch0 != patch2 && patch1 != patch2) {
-			tri_crackfaces.insert(patch_grid);
+			face_type[i] = 2;
+			key = { k0, k1, k2 };
 		}
 		else {
+			// 由于前面已经排好序，因此第一个grid号一定不大于第二个，下同
+			face_type[i] = 1;
 			if (patch0 == patch1) {
-				bi_crackfaces[patch0].insert({ grid0, grid1, patch2, grid2 }); // 由于前面已经排好序，因此grid0一定小于grid1，下同
+				key = { k0, uint64_t(uint32_t(grid1 + 1)) << 32 | uint32_t(patch2), uint64_t(uint32_t(grid2 + 1)) };
 			}
 			else if (patch1 == patch2) {
-				bi_crackfaces[patch1].insert({ grid1, grid2, patch0, grid0 });
+				key = { k1, uint64_t(uint32_t(grid2 + 1)) << 32 | uint32_t(patch0), uint64_t(uint32_t(grid0 + 1)) };
 			}
 			else {
-				bi_crackfaces[patch0].insert({ grid0, grid2, patch1, grid1 });
+				key = { k0, uint64_t(uint32_t(grid2 + 1)) << 32 | uint32_t(patch1), uint64_t(uint32_t(grid1 + 1)) };
 			}
 		}
+	}, 4096);
+
+	// 按类别收集到扁平数组，patch_origin_faces按面号顺序记录
+	std::vector<std::vector<int>>(patch_num).swap(patch_origin_faces);
+	patch_faces.clear();
+	bi_crackfaces.clear();
+	tri_crackfaces.clear();
+	for (int i = 0; i < face_num; ++i) {
+		switch (face_type[i]) {
+		case 0:
+			patch_faces.push_back({ face_key[i][0], face_key[i][1] });
+			patch_origin_faces[key_patch(face_key[i][0])].push_back(i);
+			break;
+		case 1:
+			bi_crackfaces.push_back(face_key[i]);
+			break;
+		case 2:
+			tri_crackfaces.push_back(face_key[i]);
+			break;
+		default:
+			patch_origin_faces[key_patch(face_key[i][0])].push_back(i);
+		}
 	}
+
+	// 排序去重，得到与逐个插入有序集合相同的顺序
+	radix_sort_unique(patch_faces, thread_pool);
+	radix_sort_unique(bi_crackfaces, thread_pool);
+	radix_sort_unique(tri_crackfaces, thread_pool);
+
+	// 按第一个键的patch号分组
+	auto group_by_patch = [&](const auto& keys, std::vector<int>& offset) {
+		std::vector<int>(patch_num + 1, 0).swap(offset);
+		for (const auto& key : keys) {
+			++offset[key_patch(key[0]) + 1];
+		}
+		for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+			offset[patch_id + 1] += offset[patch_id];
+		}
+	};
+	group_by_patch(patch_faces, patch_face_offset);
+	group_by_patch(bi_crackfaces, bi_crackface_offset);
 }
 
 void Compressor::serialize(std::string save_path) {
+	if (file_format == FileFormat::Binary) {
+		serialize_binary(save_path);
+	}
+	else {
+		serialize_text(save_path);
+	}
+}
+
+void Compressor::serialize_text(const std::string& save_path) {
 	std::ofstream outfile(save_path, std::ios::ate);
 	if (!outfile.is_open()) {
 		std::cout << "ERROR: 保存路径错误" << std::endl;
@@ -355,18 +1366,37 @@ void Compressor::serialize(std::string save_path) {
 	outfile << N_bins << ' ' << patch_num << std::endl;
 	outfile << std::endl;
 	// patch特征
-	outfile << patch_featuress.size() << std::endl;
-	for (int i = 0; i < patch_featuress.size(); ++i) {
-		// 算子数
-		outfile << patch_atoms[i] << std::endl;
+	outfile << patch_dictionaries.size() << std::endl;
+	// 多个字典时记录每个patch所属的聚类，聚类内的patch按patch号升序对应编码矩阵的各列
+	if (patch_dictionaries.size() > 1) {
+		for (int patch_id = 0; patch_id < patch_num - 1; ++patch_id) {
+			outfile << patch_cluster[patch_id] << ' ';
+		}
+		outfile << patch_cluster[patch_num - 1] << std::endl;
+	}
+	for (int i = 0; i < patch_dictionaries.size(); ++i) {
+		// 算子数、每列最多的非零项数(稠密编码为0)和共享字典文件的哈希(十六进制，不使用时为0)，三项总是写出；使用共享字典时不保存字典
+		outfile << patch_atoms[i] << ' ' << sparsity << ' ' << std::hex << shared_dictionary_hash << std::dec << std::endl;
 		// 字典
 		const auto& dictionary = patch_dictionaries[i];
-		for (int row = 0; row < dictionary.rows(); ++row) {
+		for (int row = 0; row < dictionary.rows() && shared_dictionary_hash == 0; ++row) {
 			for (int col = 0; col < dictionary.cols() - 1; ++col) {
 				outfile << dictionary(row, col) << ' ';
 			}
 			outfile << dictionary(row, dictionary.cols() - 1) << std::endl;
 		}
+		// 稀疏编码，每列一行：非零项数，然后依次是原子下标和值
+		if (sparsity > 0) {
+			const auto& code = patch_sparse_codes[i];
+			for (int col = 0; col + 1 < code.offset.size(); ++col) {
+				outfile << code.offset[col + 1] - code.offset[col];
+				for (int k = code.offset[col]; k < code.offset[col + 1]; ++k) {
+					outfile << ' ' << code.index[k] << ' ' << code.value[k];
+				}
+				outfile << std::endl;
+			}
+			continue;
+		}
 		// 编码
 		const auto& code = patch_codes[i];
 		for (int row = 0; row < code.rows(); ++row) {
@@ -380,7 +1410,8 @@ void Compressor::serialize(std::string save_path) {
 	// patch间连接性
 	outfile << tri_crackfaces.size() << std::endl;
 	for (const auto& face : tri_crackfaces) {
-		outfile << face[0][0] << '/' << face[0][1] << ' ' << face[1][0] << '/' << face[1][1] << ' ' << face[2][0] << '/' << face[2][1] << std::endl;
+		outfile << key_patch(face[0]) << '/' << key_grid(face[0]) << ' ' << key_patch(face[1]) << '/' << key_grid(face[1]) << ' '
+			<< key_patch(face[2]) << '/' << key_grid(face[2]) << std::endl;
 	}
 	outfile << std::endl;
 
@@ -404,14 +1435,16 @@ void Compressor::serialize(std::string save_path) {
 			outfile << patch_masks[patch_id][size - 1] << std::endl;
 		}
 		// patch内连接性
-		outfile << patch_faces[patch_id].size() << std::endl;
-		for (const auto& face : patch_faces[patch_id]) {
-			outfile << face[0] << ' ' << face[1] << ' ' << face[2] << std::endl;
+		outfile << patch_face_offset[patch_id + 1] - patch_face_offset[patch_id] << std::endl;
+		for (int i = patch_face_offset[patch_id]; i < patch_face_offset[patch_id + 1]; ++i) {
+			const auto& face = patch_faces[i];
+			outfile << key_grid(face[0]) << ' ' << int(face[1] >> 32) - 1 << ' ' << key_grid(face[1]) << std::endl;
 		}
 		// patch间连接性，但有两个顶点属于同一patch
-		outfile << bi_crackfaces[patch_id].size() << std::endl;
-		for (const auto& record : bi_crackfaces[patch_id]) {
-			outfile << record[0] << ' ' << record[1] << ' ' << record[2] << '/' << record[3] << std::endl;
+		outfile << bi_crackface_offset[patch_id + 1] - bi_crackface_offset[patch_id] << std::endl;
+		for (int i = bi_crackface_offset[patch_id]; i < bi_crackface_offset[patch_id + 1]; ++i) {
+			const auto& record = bi_crackfaces[i];
+			outfile << key_grid(record[0]) << ' ' << int(record[1] >> 32) - 1 << ' ' << int(uint32_t(record[1])) << '/' << int(record[2]) - 1 << std::endl;
 		}
 		outfile << std::endl;
 	}
@@ -419,24 +1452,493 @@ void Compressor::serialize(std::string save_path) {
 	outfile.close();
 }
 
-void Compressor::compress_and_save(int _atoms, const std::string& save_path) {
-	if (patch_vertices.size() == 0) generate_patches();
-	resample();
-	for (int i = 0; i < patch_featuress.size(); ++i) {
-		Eigen::MatrixXf dictionary, code;
-		coding(patch_featuress[i], dictionary, code, _atoms);
-		patch_atoms.push_back(dictionary.cols());
-		patch_dictionaries.push_back(std::move(dictionary));
-		patch_codes.push_back(std::move(code));
+void Compressor::serialize_binary(const std::string& save_path) {
+	if (!is_little_endian()) {
+		std::cout << "ERROR: 二进制格式只支持小端序的主机" << std::endl;
+		return;
 	}
-	record_connection();
-	serialize(save_path);
+	if (N_bins * N_bins >= 65535) {
+		std::cout << "ERROR: N_bins过大，二进制格式的grid号超出uint16范围" << std::endl;
+		return;
+	}
+	const size_t alignment = BinaryFormat::alignment;
+	int features = patch_dictionaries.size();
+	std::vector<int> cluster_size(features, 0);
+	for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+		++cluster_size[features > 1 ? patch_cluster[patch_id] : 0];
+	}
+
+	// 文件头和段表，写完各段后回填
+	std::vector<BinaryFormat::SectionEntry> sections;
+	BinaryWriter writer;
+	BinaryFormat::FileHeader header = {};
+	std::memcpy(header.magic, BinaryFormat::magic, sizeof(header.magic));
+	header.version = BinaryFormat::version;
+	header.header_size = sizeof(BinaryFormat::FileHeader);
+	header.N_bins = N_bins;
+	header.patch_num = patch_num;
+	header.section_count = features > 1 ? 7 : 6;
+	writer.write(header);
+	size_t table_offset = writer.size();
+	for (uint32_t i = 0; i < header.section_count; ++i) {
+		writer.write(BinaryFormat::SectionEntry{});
+	}
+	auto begin_section = [&](BinaryFormat::Section type, BinaryFormat::Encoding encoding = BinaryFormat::Encoding::Raw) {
+		writer.align(alignment);
+		sections.push_back({ uint32_t(type), uint32_t(encoding), writer.size(), 0 });
+	};
+	auto end_section = [&]() {
+		sections.back().size = writer.size() - sections.back().offset;
+	};
+	// 数组起点对齐后写入
+	auto write_aligned = [&](const auto* data, size_t count) {
+		writer.align(alignment);
+		writer.write_array(data, count);
+	};
+
+	// 量化时字典按列量化为16位，编码按行量化
+	bool quantized = quantization_error > 0.0f;
+	BinaryFormat::Encoding encoding = quantized ? BinaryFormat::Encoding::Quantized : BinaryFormat::Encoding::Raw;
+	// 量化后每列(字典)或每行(编码)的参数和位流，两种布局共用
+	struct QuantizedMatrix {
+		std::vector<float> offset, step;
+		std::vector<uint8_t> bits;
+		std::vector<size_t> position; // 每列或每行在stream中的起点，最后一个为stream的长度
+		std::vector<uint8_t> stream;
+	};
+	std::vector<QuantizedMatrix> quantized_dictionaries(features), quantized_codes(features);
+	// 量化后解码端得到的字典和编码，用于计算包围球
+	std::vector<Eigen::MatrixXf> decoded_dictionaries, decoded_codes;
+	if (quantized) {
+		decoded_dictionaries = patch_dictionaries;
+		decoded_codes = patch_codes;
+	}
+	double quantized_bits = 0.0, quantized_error = 0.0, quantized_values = 0.0;
+	for (int i = 0; i < features && quantized; ++i) {
+		const auto& dictionary = patch_dictionaries[i];
+		int _atoms = dictionary.cols();
+		if (shared_dictionary_hash == 0) {
+			auto& q = quantized_dictionaries[i];
+			q.offset.resize(_atoms);
+			q.step.resize(_atoms);
+			for (int k = 0; k < _atoms; ++k) {
+				fixed_quantization(dictionary.col(k).minCoeff(), dictionary.col(k).maxCoeff(), 16, q.offset[k], q.step[k]);
+				q.position.push_back(q.stream.size());
+				quantize_append(dictionary.col(k).data(), dictionary.rows(), 1, 16, q.offset[k], q.step[k], q.stream);
+			}
+			q.position.push_back(q.stream.size());
+			for (int k = 0; k < _atoms; ++k) {
+				dequantize(q.stream.data() + q.position[k], q.stream.size() - q.position[k], dictionary.rows(), 16, q.offset[k], q.step[k],
+					decoded_dictionaries[i].col(k).data());
+			}
+		}
+		if (sparsity > 0) continue;
+
+		// 各原子的量化误差独立且均匀分布时，高度的均方误差为Σ_k ‖d_k‖² step_k² / 12 / rows
+		// 令每个原子的‖d_k‖ * 最大步长相同，系数范围(与奇异值成正比)越大的原子位数越多，尾部的原子位数少甚至为0
+		const auto& code = patch_codes[i];
+		auto& q = quantized_codes[i];
+		double max_step = quantization_error * std::sqrt(12.0 * dictionary.rows() / std::max(_atoms, 1));
+		q.bits.resize(_atoms);
+		q.offset.resize(_atoms);
+		q.step.resize(_atoms);
+		Eigen::VectorXf row(code.cols());
+		for (int k = 0; k < _atoms; ++k) {
+			float norm = std::max(dictionary.col(k).norm(), 1e-12f);
+			float min = code.cols() > 0 ? code.row(k).minCoeff() : 0.0f, max = code.cols() > 0 ? code.row(k).maxCoeff() : 0.0f;
+			q.bits[k] = choose_quantization(min, max, float(max_step / norm), q.offset[k], q.step[k]);
+			q.position.push_back(q.stream.size());
+			quantize_append(code.data() + k, code.cols(), _atoms, q.bits[k], q.offset[k], q.step[k], q.stream);
+			dequantize(q.stream.data() + q.position[k], q.stream.size() - q.position[k], code.cols(), q.bits[k], q.offset[k], q.step[k], row.data());
+			decoded_codes[i].row(k) = row.transpose();
+			// 0位时误差为到中点的距离，按范围内的均匀分布估计
+			double error = q.bits[k] > 0 ? q.step[k] : max - min;
+			quantized_error += double(norm) * norm * error * error / 12.0 * code.cols() / dictionary.rows();
+			quantized_bits += double(q.bits[k]) * code.cols();
+		}
+		q.position.push_back(q.stream.size());
+		quantized_values += double(code.size());
+	}
+	if (quantized_values > 0.0) {
+		std::cout << "LOG: 编码量化为平均每个系数 " << quantized_bits / quantized_values << " 位，预测的高度均方根误差 "
+			<< std::sqrt(quantized_error / patch_num) << std::endl;
+	}
+
+	// 特征数，每个特征的描述和字典；渐进布局时字典和编码放在最后的Atoms段
+	begin_section(BinaryFormat::Section::Features, encoding);
+	writer.write(uint32_t(features));
+	for (int i = 0; i < features; ++i) {
+		const auto& dictionary = patch_dictionaries[i];
+		BinaryFormat::FeatureHeader feature = {};
+		feature.rows = dictionary.rows();
+		feature.atoms = dictionary.cols();
+		feature.columns = cluster_size[i];
+		feature.sparsity = sparsity;
+		feature.shared_hash = shared_dictionary_hash;
+		feature.nonzeros = sparsity > 0 ? patch_sparse_codes[i].index.size() : 0;
+		writer.align(alignment);
+		writer.write(feature);
+		if (shared_dictionary_hash != 0 || progressive) continue;
+		if (!quantized) {
+			write_aligned(dictionary.data(), dictionary.size());
+			continue;
+		}
+		const auto& q = quantized_dictionaries[i];
+		write_aligned(q.offset.data(), q.offset.size());
+		write_aligned(q.step.data(), q.step.size());
+		write_aligned(q.stream.data(), q.stream.size());
+	}
+	end_section();
+
+	// 编码
+	if (!progressive) {
+		begin_section(BinaryFormat::Section::Codes, encoding);
+		for (int i = 0; i < features; ++i) {
+			if (quantized && sparsity == 0) {
+				const auto& q = quantized_codes[i];
+				write_aligned(q.offset.data(), q.offset.size());
+				write_aligned(q.step.data(), q.step.size());
+				write_aligned(q.bits.data(), q.bits.size());
+				write_aligned(q.stream.data(), q.stream.size());
+			}
+			else if (sparsity > 0) {
+				const auto& code = patch_sparse_codes[i];
+				write_aligned(code.offset.data(), code.offset.size());
+				write_aligned(code.index.data(), code.index.size());
+				write_aligned(code.value.data(), code.value.size());
+			}
+			else {
+				write_aligned(patch_codes[i].data(), patch_codes[i].size());
+			}
+		}
+		end_section();
+	}
+
+	// 多个字典时每个patch所属的聚类
+	if (features > 1) {
+		begin_section(BinaryFormat::Section::Clusters);
+		writer.write_array(patch_cluster.data(), patch_num);
+		end_section();
+	}
+
+	// seed、网格尺寸和偏移：seed坐标和法线的位模式与上一个patch做差分，按字节平面保存，差值的高位字节多为0，熵编码时更短
+	// patch按空间顺序编号时差值更小
+	begin_section(BinaryFormat::Section::Patches, BinaryFormat::Encoding::Delta);
+	std::vector<uint8_t> planes(size_t(patch_num) * 24);
+	uint32_t previous[6] = {};
+	for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+		int seed_id = patch_vertices[patch_id][0];
+		float components[6];
+		for (int k = 0; k < 3; ++k) {
+			components[k] = origin_vertices->at(seed_id)[k];
+			components[k + 3] = origin_normals->at(seed_id)[k];
+		}
+		for (int k = 0; k < 6; ++k) {
+			uint32_t bits;
+			std::memcpy(&bits, &components[k], sizeof(bits));
+			uint32_t delta = zigzag_encode(int32_t(bits - previous[k]));
+			previous[k] = bits;
+			for (int j = 0; j < 4; ++j) {
+				planes[size_t(k * 4 + j) * patch_num + patch_id] = uint8_t(delta >> (j * 8));
+			}
+		}
+	}
+	writer.write_array(planes.data(), planes.size());
+	std::vector<float> seed_bias(patch_num * 2);
+	for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+		seed_bias[patch_id * 2] = patch_seed_bias[patch_id][0];
+		seed_bias[patch_id * 2 + 1] = patch_seed_bias[patch_id][1];
+	}
+	write_aligned(patch_grid_span.data(), patch_num);
+	write_aligned(seed_bias.data(), seed_bias.size());
+	end_section();
+
+	// 包围球
+	std::vector<Eigen::Vector4f> bounds;
+	compute_patch_bounds(quantized ? decoded_dictionaries : patch_dictionaries, quantized ? decoded_codes : patch_codes, bounds);
+	begin_section(BinaryFormat::Section::Bounds);
+	for (const auto& bound : bounds) {
+		writer.write(BinaryFormat::PatchBound{ { bound[0], bound[1], bound[2] }, bound[3] });
+	}
+	end_section();
+
+	// 掩码，每个patch保存为定长位图；N_bins=10时每个patch 13字节，不受顶点数影响
+	begin_section(BinaryFormat::Section::Masks, BinaryFormat::Encoding::Bitset);
+	size_t mask_bytes = (N_bins * N_bins + 7) / 8;
+	std::vector<uint8_t> mask_bits(mask_bytes * patch_num, 0);
+	for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+		uint8_t* bits = mask_bits.data() + mask_bytes * patch_id;
+		for (int grid : patch_masks[patch_id]) {
+			bits[grid >> 3] |= uint8_t(1u << (grid & 7));
+		}
+	}
+	writer.write_array(mask_bits.data(), mask_bits.size());
+	end_section();
+
+	// 连接性，grid号加1保存
+	begin_section(BinaryFormat::Section::Connectivity);
+	uint32_t counts[4] = { uint32_t(patch_faces.size()), uint32_t(bi_crackfaces.size()), uint32_t(tri_crackfaces.size()), 0 };
+	writer.write_array(counts, 4);
+	std::vector<uint16_t> grids;
+	for (const auto& face : patch_faces) {
+		grids.insert(grids.end(), { uint16_t(face[0]), uint16_t(face[1] >> 32), uint16_t(face[1]) });
+	}
+	write_aligned(patch_face_offset.data(), patch_face_offset.size());
+	write_aligned(grids.data(), grids.size());
+	grids.clear();
+	std::vector<int> patches;
+	for (const auto& record : bi_crackfaces) {
+		grids.insert(grids.end(), { uint16_t(record[0]), uint16_t(record[1] >> 32), uint16_t(record[2]) });
+		patches.push_back(int(uint32_t(record[1])));
+	}
+	write_aligned(bi_crackface_offset.data(), bi_crackface_offset.size());
+	write_aligned(grids.data(), grids.size());
+	write_aligned(patches.data(), patches.size());
+	grids.clear();
+	patches.clear();
+	for (const auto& face : tri_crackfaces) {
+		for (uint64_t key : face) {
+			patches.push_back(key_patch(key));
+			grids.push_back(uint16_t(key));
+		}
+	}
+	write_aligned(patches.data(), patches.size());
+	write_aligned(grids.data(), grids.size());
+	end_section();
+
+	// 渐进布局：第k层依次为各特征字典的第k列和编码的第k行，原子按奇异值从大到小排列，解码端读完前k层即可用前k个原子还原
+	// 熵编码时每层单独编码，使各层可以独立解码
+	if (progressive) {
+		int levels = 0;
+		for (const auto& dictionary : patch_dictionaries) {
+			levels = std::max(levels, int(dictionary.cols()));
+		}
+		std::vector<BinaryWriter> level_writers(levels);
+		Eigen::VectorXf row;
+		for (int k = 0; k < levels; ++k) {
+			BinaryWriter& level = level_writers[k];
+			for (int i = 0; i < features; ++i) {
+				const auto& dictionary = patch_dictionaries[i];
+				const auto& code = patch_codes[i];
+				if (k >= dictionary.cols()) continue;
+				if (quantized) {
+					if (shared_dictionary_hash == 0) {
+						const auto& q = quantized_dictionaries[i];
+						level.write(q.offset[k]);
+						level.write(q.step[k]);
+						level.align(alignment);
+						level.write_array(q.stream.data() + q.position[k], q.position[k + 1] - q.position[k]);
+					}
+					const auto& q = quantized_codes[i];
+					level.align(alignment);
+					level.write(q.offset[k]);
+					level.write(q.step[k]);
+					level.write(q.bits[k]);
+					level.align(alignment);
+					level.write_array(q.stream.data() + q.position[k], q.position[k + 1] - q.position[k]);
+				}
+				else {
+					if (shared_dictionary_hash == 0) {
+						level.align(alignment);
+						level.write_array(dictionary.col(k).data(), dictionary.rows());
+					}
+					row = code.row(k).transpose();
+					level.align(alignment);
+					level.write_array(row.data(), row.size());
+				}
+				level.align(alignment);
+			}
+		}
+		bool coded = false;
+		std::vector<std::vector<uint8_t>> encoded(levels);
+		if (entropy_coding) {
+			size_t raw_bytes = 0, coded_bytes = 0;
+			for (int k = 0; k < levels; ++k) {
+				const auto& raw = level_writers[k].buffer();
+				rans_encode(reinterpret_cast<const uint8_t*>(raw.data()), raw.size(), encoded[k], thread_pool);
+				raw_bytes += raw.size();
+				coded_bytes += encoded[k].size();
+			}
+			coded = coded_bytes < raw_bytes;
+		}
+		begin_section(BinaryFormat::Section::Atoms, encoding);
+		if (coded) {
+			sections.back().encoding |= BinaryFormat::entropy_coded;
+		}
+		size_t section_offset = sections.back().offset;
+		writer.write(uint32_t(levels));
+		writer.write(uint32_t(0));
+		size_t level_table = writer.size();
+		std::vector<uint64_t> level_offset(levels + 1, 0);
+		writer.write_array(level_offset.data(), level_offset.size());
+		for (int k = 0; k < levels; ++k) {
+			writer.align(alignment);
+			level_offset[k] = writer.size() - section_offset;
+			if (coded) {
+				writer.write_array(encoded[k].data(), encoded[k].size());
+			}
+			else {
+				writer.write_array(level_writers[k].buffer().data(), level_writers[k].buffer().size());
+			}
+		}
+		level_offset[levels] = writer.size() - section_offset;
+		for (int k = 0; k <= levels; ++k) {
+			writer.overwrite(level_table + k * sizeof(uint64_t), level_offset[k]);
+		}
+		end_section();
+	}
+
+	// 熵编码：各段分块并行编码，编码后不比原数据小的段保持原样；Atoms段已经按层编码
+	if (entropy_coding) {
+		BinaryWriter coded;
+		coded.write_array(writer.buffer().data(), table_offset + sections.size() * sizeof(BinaryFormat::SectionEntry));
+		std::vector<uint8_t> encoded;
+		for (auto& entry : sections) {
+			const uint8_t* raw = reinterpret_cast<const uint8_t*>(writer.buffer().data()) + entry.offset;
+			if (entry.type == uint32_t(BinaryFormat::Section::Atoms)) {
+				coded.align(alignment);
+				entry.offset = coded.size();
+				coded.write_array(raw, entry.size);
+				continue;
+			}
+			rans_encode(raw, entry.size, encoded, thread_pool);
+			coded.align(alignment);
+			entry.offset = coded.size();
+			if (encoded.size() < entry.size) {
+				coded.write_array(encoded.data(), encoded.size());
+				entry.size = encoded.size();
+				entry.encoding |= BinaryFormat::entropy_coded;
+			}
+			else {
+				coded.write_array(raw, entry.size);
+			}
+		}
+		writer = std::move(coded);
+	}
+	for (int i = 0; i < sections.size(); ++i) {
+		writer.overwrite(table_offset + i * sizeof(BinaryFormat::SectionEntry), sections[i]);
+	}
+	if (!writer.save(save_path)) {
+		std::cout << "ERROR: 保存路径错误" << std::endl;
+	}
+}
+
+void Compressor::compute_patch_bounds(const std::vector<Eigen::MatrixXf>& dictionaries, const std::vector<Eigen::MatrixXf>& codes, std::vector<Eigen::Vector4f>& bounds) {
+	// 与Parser::reconstruct相同的方式还原顶点：聚类内的patch按patch号升序对应编码矩阵的各列
+	int features = dictionaries.size();
+	std::vector<int> patch_column(patch_num), column_count(features, 0);
+	for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+		patch_column[patch_id] = column_count[features > 1 ? patch_cluster[patch_id] : 0]++;
+	}
+	struct BoundScratch {
+		std::vector<float> x, y, z;
+		Eigen::VectorXf height;
+	};
+	std::vector<BoundScratch> scratches(thread_pool.size());
+	bounds.resize(patch_num);
+	dispatch_grid_kernel(N_bins, [&](auto kernel) {
+		thread_pool.parallel_for(0, patch_num, [&](int patch_id, int thread_index) {
+			BoundScratch& scratch = scratches[thread_index];
+			int cluster = features > 1 ? patch_cluster[patch_id] : 0;
+			int column = patch_column[patch_id];
+			if (sparsity > 0) {
+				const auto& code = patch_sparse_codes[cluster];
+				scratch.height.setZero(dictionaries[cluster].rows());
+				for (int k = code.offset[column]; k < code.offset[column + 1]; ++k) {
+					scratch.height += code.value[k] * dictionaries[cluster].col(code.index[k]);
+				}
+			}
+			else {
+				scratch.height.noalias() = dictionaries[cluster] * codes[cluster].col(column);
+			}
+
+			const auto& mask = patch_masks[patch_id];
+			int n = mask.size();
+			scratch.x.resize(n);
+			scratch.y.resize(n);
+			scratch.z.resize(n);
+			kernel.grid_center(mask.data(), n, patch_grid_span[patch_id], patch_seed_bias[patch_id][0], patch_seed_bias[patch_id][1],
+				scratch.x.data(), scratch.y.data());
+			for (int i = 0; i < n; ++i) {
+				scratch.z[i] = scratch.height[mask[i]];
+			}
+			int seed_id = patch_vertices[patch_id][0];
+			LocalFrame frame = LocalFrame::from_transform(generate_transform(origin_vertices->at(seed_id), origin_normals->at(seed_id))).inverse();
+			transform_points(frame, scratch.x.data(), scratch.y.data(), scratch.z.data(), n, scratch.x.data(), scratch.y.data(), scratch.z.data());
+
+			Eigen::AlignedBox3f box(origin_vertices->at(seed_id));
+			for (int i = 0; i < n; ++i) {
+				box.extend(Eigen::Vector3f(scratch.x[i], scratch.y[i], scratch.z[i]));
+			}
+			Eigen::Vector3f center = box.center();
+			float radius = (origin_vertices->at(seed_id) - center).norm();
+			for (int i = 0; i < n; ++i) {
+				radius = std::max(radius, (Eigen::Vector3f(scratch.x[i], scratch.y[i], scratch.z[i]) - center).norm());
+			}
+			// 解码端矩阵乘法的累加顺序可能不同，半径略微放大以包含舍入误差
+			bounds[patch_id] << center, radius * 1.0001f + 1e-6f;
+		}, 16);
+	});
+}
+
+void Compressor::compress_and_save(int _atoms, const std::string& save_path) {
+	compress(_atoms, save_path);
 	//check(1);
 	//check(2);
 	//check(3);
+	//check(4);
+	//check(5);
+	//check(6);
+	//check(7);
+	//check(8);
+	//check(9);
+	//check(10);
 
 }
 
+void Compressor::compress(int _atoms, const std::string& save_path) {
+	EigenThreadScope eigen_threads(deterministic);
+	if (patch_vertices.size() == 0) generate_patches();
+	if (coding_chunk > 0 || shared_dictionary.size() > 0) {
+		// 使用共享字典时不需要完整的特征矩阵，同样分块投影
+		streaming_coding(_atoms);
+	}
+	else {
+		resample();
+		if (clusters > 1) {
+			cluster_features();
+		}
+		// 各聚类的字典相互独立，并行编码
+		int features = patch_featuress.size();
+		std::vector<Eigen::MatrixXf>(features).swap(patch_dictionaries);
+		std::vector<Eigen::MatrixXf>(features).swap(patch_codes);
+		std::vector<SparseCode>(sparsity > 0 ? features : 0).swap(patch_sparse_codes);
+		thread_pool.parallel_for(0, features, [&](int i, int) {
+			if (sparsity > 0) {
+				sparse_coding(patch_featuress[i], patch_dictionaries[i], patch_sparse_codes[i]);
+				return;
+			}
+			coding(patch_featuress[i], patch_dictionaries[i], patch_codes[i], _atoms);
+			if (masked_iterations > 0) {
+				// 特征矩阵的各列对应的patch：不聚类时即列号，聚类时为该类的patch按patch号升序排列
+				std::vector<int> column_patch;
+				for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+					if (patch_cluster.empty() || patch_cluster[patch_id] == i) {
+						column_patch.push_back(patch_id);
+					}
+				}
+				masked_coding(patch_featuress[i], column_patch, patch_dictionaries[i], patch_codes[i]);
+			}
+		});
+		for (const auto& dictionary : patch_dictionaries) {
+			patch_atoms.push_back(dictionary.cols());
+		}
+	}
+	record_connection();
+	serialize(save_path);
+	std::cout << "LOG: 压缩文件哈希 " << std::hex << fnv1a_hash_file(save_path) << std::dec << std::endl;
+}
+
 void Compressor::check(int part) {
 	std::cout << std::endl;
 	std::cout << "----------check " << part << "----------" << std::endl;
@@ -512,6 +2014,369 @@ void Compressor::check(int part) {
 			}
 		}
 	}
+	else if (part == 4) {
+		// 局部坐标变换的基准测试：逐点4x4矩阵乘法、标量批量变换、向量化批量变换
+		std::vector<Eigen::Matrix4f> transforms;
+		std::vector<LocalFrame> frames;
+		std::vector<int> offsets = { 0 };
+		std::vector<float> x, y, z;
+		for (const auto& patch : patch_vertices) {
+			transforms.push_back(generate_transform(origin_vertices->at(patch[0]), origin_normals->at(patch[0])));
+			frames.push_back(LocalFrame::from_transform(transforms.back()));
+			for (int i = 1; i < patch.size(); ++i) {
+				x.push_back(origin_vertices->at(patch[i])[0]);
+				y.push_back(origin_vertices->at(patch[i])[1]);
+				z.push_back(origin_vertices->at(patch[i])[2]);
+			}
+			offsets.push_back(x.size());
+		}
+		std::vector<float> out_x(x.size()), out_y(x.size()), out_z(x.size()), ref_x(x.size()), ref_y(x.size()), ref_z(x.size());
+		const int repeat = 100;
+		auto run = [&](const char* name, const std::function<void(int)>& kernel) {
+			auto start = std::chrono::steady_clock::now();
+			for (int r = 0; r < repeat; ++r) {
+				for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+					kernel(patch_id);
+				}
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << name << ": " << seconds * 1e9 / (double(repeat) * x.size()) << " ns/点" << std::endl;
+		};
+		run("Matrix4f逐点变换", [&](int patch_id) {
+			const Eigen::Matrix4f& transform = transforms[patch_id];
+			for (int i = offsets[patch_id]; i < offsets[patch_id + 1]; ++i) {
+				Eigen::Vector4f local_cord = transform * Eigen::Vector4f(x[i], y[i], z[i], 1.0f);
+				local_cord /= local_cord[3];
+				ref_x[i] = local_cord[0];
+				ref_y[i] = local_cord[1];
+				ref_z[i] = local_cord[2];
+			}
+		});
+		run("标量批量变换", [&](int patch_id) {
+			int first = offsets[patch_id], n = offsets[patch_id + 1] - first;
+			transform_points_scalar(frames[patch_id], &x[first], &y[first], &z[first], n, &ref_x[first], &ref_y[first], &ref_z[first]);
+		});
+		run("向量化批量变换", [&](int patch_id) {
+			int first = offsets[patch_id], n = offsets[patch_id + 1] - first;
+			transform_points(frames[patch_id], &x[first], &y[first], &z[first], n, &out_x[first], &out_y[first], &out_z[first]);
+		});
+		float max_error = 0.0f;
+		for (int i = 0; i < x.size(); ++i) {
+			max_error = std::max({ max_error, std::abs(out_x[i] - ref_x[i]), std::abs(out_y[i] - ref_y[i]), std::abs(out_z[i] - ref_z[i]) });
+		}
+		std::cout << "向量化结果与标量结果的最大误差: " << max_error << std::endl;
+	}
+	else if (part == 5) {
+		// 各分解方法的耗时和重建误差，算子数取压缩时实际使用的值
+		if (patch_featuress.empty()) {
+			std::cout << "流式编码时不保存特征矩阵" << std::endl;
+			return;
+		}
+		SvdBackend used_backend = svd_backend;
+		const Eigen::MatrixXf& feature = patch_featuress[0];
+		int _atoms = patch_atoms.empty() ? -1 : patch_atoms[0];
+		const std::pair<SvdBackend, const char*> backends[] = {
+			{ SvdBackend::Jacobi, "jacobi" }, { SvdBackend::BDC, "bdc" }, { SvdBackend::Gram, "gram" }, { SvdBackend::Randomized, "randomized" } };
+		for (const auto& backend : backends) {
+			svd_backend = backend.first;
+			Eigen::MatrixXf dictionary, code;
+			auto start = std::chrono::steady_clock::now();
+			coding(feature, dictionary, code, _atoms);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			float rms_error = (feature - dictionary * code).norm() / std::sqrt(float(feature.size()));
+			std::cout << backend.second << ": " << seconds * 1e3 << " ms, 重建均方根误差 " << rms_error << std::endl;
+		}
+		svd_backend = used_backend;
+	}
+	else if (part == 6) {
+		// 文本格式、二进制格式及其熵编码的文件大小与编解码耗时，临时文件写在当前目录
+		FileFormat used_format = file_format;
+		bool used_entropy_coding = entropy_coding;
+		std::vector<uint8_t> raw_binary; // 未熵编码的二进制文件，用于测量rANS的解码吞吐量
+		const std::tuple<FileFormat, bool, const char*> formats[] = {
+			{ FileFormat::Text, false, "text" }, { FileFormat::Binary, false, "binary" }, { FileFormat::Binary, true, "binary_rans" } };
+		for (const auto& format : formats) {
+			std::string path = std::string("check_format.") + std::get<2>(format);
+			file_format = std::get<0>(format);
+			entropy_coding = std::get<1>(format);
+			auto start = std::chrono::steady_clock::now();
+			serialize(path);
+			double encode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			std::vector<Eigen::Vector3f> vertices;
+			std::vector<std::vector<int>> faces;
+			std::vector<float> vertex_data, color_data;
+			Parser parser;
+			parser.init(&vertices, &faces, &vertex_data, &color_data);
+			if (shared_dictionary_hash != 0) {
+				parser.add_shared_dictionary(shared_dictionary, shared_dictionary_hash);
+			}
+			start = std::chrono::steady_clock::now();
+			parser.parse(path);
+			double decode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			std::ifstream infile(path, std::ios::binary);
+			std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+			infile.close();
+			parser.close();
+			std::remove(path.c_str());
+			std::cout << std::get<2>(format) << ": " << buffer.size() << " 字节，编码 " << encode_seconds * 1e3 << " ms，解码 " << decode_seconds * 1e3
+				<< " ms，还原顶点数 " << vertices.size() << std::endl;
+			if (std::get<0>(format) == FileFormat::Binary && !std::get<1>(format)) {
+				raw_binary = std::move(buffer);
+			}
+		}
+		// rANS单核解码吞吐量：整个二进制文件作为输入，取多次中最快的一次
+		ThreadPool single_thread;
+		single_thread.init(1);
+		std::vector<uint8_t> encoded, decoded;
+		rans_encode(raw_binary.data(), raw_binary.size(), encoded, single_thread);
+		for (bool vectorized : { true, false }) {
+			double best_seconds = std::numeric_limits<double>::max();
+			for (int repeat = 0; repeat < 10; ++repeat) {
+				auto start = std::chrono::steady_clock::now();
+				bool decoded_ok = vectorized ? rans_decode(encoded.data(), encoded.size(), decoded, single_thread)
+					: rans_decode_scalar(encoded.data(), encoded.size(), decoded, single_thread);
+				best_seconds = std::min(best_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+				if (!decoded_ok || decoded != raw_binary) {
+					std::cout << "ERROR: rANS解码结果与原数据不同" << std::endl;
+					break;
+				}
+			}
+			std::cout << (vectorized ? "rANS解码(运行时选择AVX2或标量): " : "rANS解码(标量): ") << raw_binary.size() / best_seconds / 1e6 << " MB/s，单线程" << std::endl;
+		}
+		file_format = used_format;
+		entropy_coding = used_entropy_coding;
+	}
+	else if (part == 7) {
+		// 按区域解码：只还原包围盒一个八分之一角内的patch，与完整解码比较耗时和选中patch的顶点
+		FileFormat used_format = file_format;
+		file_format = FileFormat::Binary;
+		std::string path = "check_region.binary";
+		serialize(path);
+		file_format = used_format;
+		Eigen::AlignedBox3f box;
+		for (const auto& vertex : *origin_vertices) {
+			box.extend(vertex);
+		}
+		Eigen::AlignedBox3f region(box.min(), box.center());
+
+		struct Decoded {
+			std::vector<Eigen::Vector3f> vertices;
+			std::vector<std::vector<int>> faces;
+			std::vector<float> vertex_data, color_data;
+			std::vector<std::vector<Eigen::Vector3f>> patch_vertices;
+			double seconds;
+		};
+		auto decode = [&](bool partial) {
+			Decoded decoded;
+			Parser parser;
+			parser.init(&decoded.vertices, &decoded.faces, &decoded.vertex_data, &decoded.color_data);
+			if (shared_dictionary_hash != 0) {
+				parser.add_shared_dictionary(shared_dictionary, shared_dictionary_hash);
+			}
+			auto start = std::chrono::steady_clock::now();
+			if (partial) {
+				parser.parse_region(path, region);
+			}
+			else {
+				parser.parse(path);
+			}
+			decoded.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			const std::vector<std::vector<int>>* _patch_faces;
+			const std::vector<int>* _vertex_to_patch;
+			const std::vector<int>* _patch_size;
+			int _feature_len, _atoms;
+			parser.write_patch_info(_patch_faces, _vertex_to_patch, _patch_size, _feature_len, _atoms);
+			decoded.patch_vertices.resize(patch_num);
+			for (int i = 0; i < decoded.vertices.size(); ++i) {
+				decoded.patch_vertices[_vertex_to_patch->at(i)].push_back(decoded.vertices[i]);
+			}
+			return decoded;
+		};
+		Decoded full = decode(false), partial = decode(true);
+		std::remove(path.c_str());
+
+		// 选中的patch顶点完整，其余patch只有缝隙面用到的顶点
+		int selected = 0, halo = 0;
+		float max_error = 0.0f;
+		for (int patch_id = 0; patch_id < patch_num; ++patch_id) {
+			const auto& vertices = partial.patch_vertices[patch_id];
+			if (vertices.empty()) continue;
+			if (vertices.size() < full.patch_vertices[patch_id].size()) {
+				++halo;
+				continue;
+			}
+			++selected;
+			for (int i = 0; i < vertices.size(); ++i) {
+				max_error = std::max(max_error, (vertices[i] - full.patch_vertices[patch_id][i]).cwiseAbs().maxCoeff());
+			}
+		}
+		std::cout << "完整解码: " << full.vertices.size() << " 个顶点，" << full.faces.size() << " 个面，" << full.seconds * 1e3 << " ms" << std::endl;
+		std::cout << "区域解码: 选中 " << selected << " / " << patch_num << " 个patch，另有 " << halo << " 个patch只还原缝隙面的顶点，"
+			<< partial.vertices.size() << " 个顶点，" << partial.faces.size() << " 个面，" << partial.seconds * 1e3 << " ms" << std::endl;
+		std::cout << "选中patch的顶点与完整解码的最大误差 " << max_error << std::endl;
+	}
+	else if (part == 8) {
+		// 渐进解码：只读前k层时的耗时和顶点误差，以及从1个原子逐步refine到全部原子的结果是否与完整解码相同
+		FileFormat used_format = file_format;
+		bool used_progressive = progressive;
+		file_format = FileFormat::Binary;
+		progressive = sparsity == 0;
+		std::string path = "check_progressive.binary";
+		serialize(path);
+		file_format = used_format;
+		progressive = used_progressive;
+
+		std::vector<Eigen::Vector3f> vertices, full_vertices;
+		std::vector<std::vector<int>> faces;
+		std::vector<float> vertex_data, color_data;
+		Parser parser;
+		parser.init(&vertices, &faces, &vertex_data, &color_data);
+		if (shared_dictionary_hash != 0) {
+			parser.add_shared_dictionary(shared_dictionary, shared_dictionary_hash);
+		}
+		auto rms_error = [&]() {
+			double error = 0.0;
+			for (int i = 0; i < vertices.size(); ++i) {
+				error += (vertices[i] - full_vertices[i]).squaredNorm();
+			}
+			return std::sqrt(error / std::max<size_t>(vertices.size(), 1));
+		};
+		auto start = std::chrono::steady_clock::now();
+		parser.parse(path);
+		double full_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		full_vertices = vertices;
+		std::cout << "完整解码: " << vertices.size() << " 个顶点，" << full_seconds * 1e3 << " ms" << std::endl;
+		int max_atoms = 1;
+		for (const auto& dictionary : patch_dictionaries) {
+			max_atoms = std::max(max_atoms, int(dictionary.cols()));
+		}
+		for (int k = 1; k < max_atoms; k *= 2) {
+			start = std::chrono::steady_clock::now();
+			parser.parse(path, k);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "前 " << k << " 个原子: " << seconds * 1e3 << " ms，顶点均方根误差 " << rms_error() << std::endl;
+		}
+		parser.parse(path, 1);
+		double refine_seconds = 0.0;
+		for (int k = 2; k <= max_atoms; ++k) {
+			start = std::chrono::steady_clock::now();
+			parser.refine(k);
+			refine_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		std::cout << "逐个原子refine到 " << max_atoms << " 个原子共 " << refine_seconds * 1e3 << " ms，与完整解码的均方根误差 " << rms_error() << std::endl;
+
+		// 渐进传输：文件只写到Atoms段的一半时解码，在映射期间追加其余内容，refine重新映射后应当与完整解码相同
+		std::ifstream infile(path, std::ios::binary);
+		std::vector<char> buffer((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+		infile.close();
+		size_t cut = 0;
+		BinaryReader reader(buffer.data(), buffer.size());
+		BinaryFormat::FileHeader header;
+		if (reader.read(header) && reader.seek(header.header_size)) {
+			BinaryFormat::SectionEntry entry;
+			for (uint32_t i = 0; i < header.section_count && reader.read(entry); ++i) {
+				if (entry.type == uint32_t(BinaryFormat::Section::Atoms)) cut = entry.offset + entry.size / 2;
+			}
+		}
+		if (cut > 0) {
+			std::string partial_path = "check_progressive_partial.binary";
+			std::ofstream outfile(partial_path, std::ios::binary);
+			outfile.write(buffer.data(), cut);
+			outfile.close();
+			parser.parse(partial_path);
+			// 以追加方式写入，Windows下不能截断已映射的文件
+			outfile.open(partial_path, std::ios::binary | std::ios::app);
+			outfile.write(buffer.data() + cut, buffer.size() - cut);
+			outfile.close();
+			start = std::chrono::steady_clock::now();
+			bool refined = parser.refine(0);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "文件写到 " << cut << " / " << buffer.size() << " 字节时解码，追加后refine" << (refined ? "" : "失败") << ": " << seconds * 1e3
+				<< " ms，与完整解码的均方根误差 " << rms_error() << std::endl;
+			parser.close();
+			std::remove(partial_path.c_str());
+		}
+		parser.close();
+		std::remove(path.c_str());
+	}
+	else if (part == 9) {
+		// 确定性：每个网格分别用1、2、8和全部硬件线程压缩，压缩文件的哈希应当相同
+		std::vector<std::string> mesh_paths = { "resource/mesh/FinalBaseMesh.obj", "resource/mesh/sword.obj", "resource/mesh/nanosuit/nanosuit.obj" };
+		std::vector<int> thread_counts = { 1, 2, 8, std::max(1, int(std::thread::hardware_concurrency())) };
+		std::string path = "check_threads.data";
+		int mismatches = 0;
+		for (const auto& mesh_path : mesh_paths) {
+			std::vector<Eigen::Vector3f> vertices, normals;
+			std::vector<std::vector<int>> faces;
+			std::vector<float> vertex_data, color_data;
+			ObjLoader obj_loader;
+			obj_loader.init(&vertices, &faces, &normals, &vertex_data, &color_data);
+			if (!obj_loader.load_obj_mesh(mesh_path)) {
+				std::cout << "ERROR: 加载网格出错 " << mesh_path << std::endl;
+				++mismatches;
+				continue;
+			}
+			uint64_t reference = 0;
+			for (int i = 0; i < thread_counts.size(); ++i) {
+				int threads = thread_counts[i];
+				Config thread_config = *init_config;
+				thread_config.threads = threads;
+				thread_config.deterministic = true;
+				Compressor compressor;
+				compressor.init(&vertices, &faces, &normals, thread_config);
+				if (shared_dictionary_hash != 0) {
+					compressor.set_shared_dictionary(shared_dictionary, shared_dictionary_hash);
+				}
+				compressor.compress(thread_config.atoms, path);
+				uint64_t hash = fnv1a_hash_file(path);
+				if (i == 0) reference = hash;
+				bool same = hash == reference && hash != 0;
+				mismatches += !same;
+				std::cout << mesh_path << " " << threads << " 线程: 哈希 " << std::hex << hash << std::dec << (same ? "" : "，与单线程不一致") << std::endl;
+			}
+		}
+		std::remove(path.c_str());
+		std::cout << (mismatches == 0 ? "所有线程数的压缩结果一致" : "ERROR: 压缩结果与线程数有关，不一致 " + std::to_string(mismatches) + " 次") << std::endl;
+	}
+	else if (part == 10) {
+		// 互不兼容的模式组合：init应当关闭其中一个并输出LOG，压缩和解压都能正常完成
+		struct Combination {
+			std::string name;
+			std::function<void(Config&)> apply;
+		};
+		std::vector<Combination> combinations = {
+			{ "稀疏编码 + 流式编码", [](Config& mode) { mode.sparsity = 4; mode.sparse_atoms = 50; mode.coding_chunk = 100; } },
+			{ "聚类 + 流式编码", [](Config& mode) { mode.clusters = 4; mode.coding_chunk = 100; } },
+			{ "掩码加权ALS + 流式编码", [](Config& mode) { mode.masked_iterations = 2; mode.coding_chunk = 100; } },
+		};
+		std::string path = "check_modes.data";
+		for (const auto& combination : combinations) {
+			std::cout << combination.name << std::endl;
+			Config mode_config = *init_config;
+			combination.apply(mode_config);
+			Compressor compressor;
+			compressor.init(origin_vertices, origin_faces, origin_normals, mode_config);
+			if (shared_dictionary_hash != 0) {
+				compressor.set_shared_dictionary(shared_dictionary, shared_dictionary_hash);
+			}
+			compressor.compress(mode_config.atoms, path);
+
+			std::vector<Eigen::Vector3f> vertices;
+			std::vector<std::vector<int>> faces;
+			std::vector<float> vertex_data, color_data;
+			Parser parser;
+			parser.init(&vertices, &faces, &vertex_data, &color_data);
+			if (shared_dictionary_hash != 0) {
+				parser.add_shared_dictionary(shared_dictionary, shared_dictionary_hash);
+			}
+			parser.parse(path);
+			std::cout << "还原 " << vertices.size() << " 个顶点，" << faces.size() << " 个面，压缩文件哈希 "
+				<< std::hex << fnv1a_hash_file(path) << std::dec << std::endl;
+		}
+		std::remove(path.c_str());
+	}
 	std::cout << std::endl;
 }
 
@@ -1,21 +1,53 @@
 ﻿#pragma once
 
 #include <core/core.h>
+#include <core/data.h>
+#include <tools/thread_pool.h>
+#include <array>
+#include <cstdint>
+#include <optional>
 
 class Compressor {
 public:
+	// patch生长方式
+	enum class PatchGrowth {
+		BFS, // 按跳数逐层扩展
+		Geodesic // 按测地距离(边长之和)由近到远扩展
+	};
+	// patch编号顺序
+	enum class PatchOrder {
+		Curvature, // seed被选中的顺序，即曲率从大到小
+		Morton // 按seed坐标的Morton码排序，编号相邻的patch在空间上也相邻
+	};
+	// 编码时使用的分解方法
+	enum class SvdBackend {
+		Jacobi, // Eigen::JacobiSVD，最慢但最稳定
+		BDC, // Eigen::BDCSVD，分治法，矩阵较大时比Jacobi快得多
+		Gram, // 对N_bins^2 × N_bins^2的Gram矩阵F * F^T做特征值分解，只与特征长度有关，patch数很多时最快
+		Randomized // 随机投影求F的近似值域后只分解atoms + svd_oversampling维的子空间，耗时随atoms增长
+	};
+	// 压缩文件格式
+	enum class FileFormat {
+		Text, // 文本格式，小数保留float_precision位
+		Binary // 二进制格式，见BinaryFormat
+	};
+
 	Compressor();
 	~Compressor();
 
 	// 初始化
 	void init(const std::vector<Eigen::Vector3f>* in_vertices, const std::vector<std::vector<int>>* in_faces,
-		const std::vector<Eigen::Vector3f>* in_normals, int _N_bins, int _patch_size_limit, float _patch_normal_tolerance, int _float_precision);
+		const std::vector<Eigen::Vector3f>* in_normals, const Config& config);
 	// 执行算法并保存编码文件
 	void compress_and_save(int _atoms, const std::string& save_path);
 	// 根据硬patch划分写颜色数据
 	void generate_patch_color(std::vector<float>* color_data);
 	// 根据坐标和法线，为seed生成局部坐标系的transform
 	static Eigen::Matrix4f generate_transform(const Eigen::Vector3f& cord, const Eigen::Vector3f& in_normal);
+	// 使用预训练的共享字典，压缩时只做投影，压缩文件通过hash引用字典
+	bool set_shared_dictionary(const Eigen::MatrixXf& dictionary, uint64_t hash);
+	// 用于训练共享字典：划分patch并重采样，把特征矩阵的Gram矩阵累加到gram上，返回patch数
+	int accumulate_training_gram(Eigen::MatrixXd& gram);
 	// 记录patch相关信息
 	void write_patch_info(const std::vector<std::vector<int>>*& _patch_faces, const std::vector<int>*& _vertex_to_patch, 
 		const std::vector<int>*& _patch_size, int& _feature_len, int& _atoms);
@@ -26,16 +58,44 @@ private:
 	int N_bins = 10; // grid划分精度，grid数量为N_bins * N_bins
 	int patch_size_limit = 22;
 	float patch_normal_tolerance = 90.0f;
+	PatchGrowth patch_growth = PatchGrowth::BFS;
+	PatchOrder patch_order = PatchOrder::Curvature;
+	SvdBackend svd_backend = SvdBackend::Jacobi;
+	int svd_oversampling = 10;
+	int svd_power_iterations = 2;
+	int coding_chunk = 0; // 流式编码时每块的patch数，0表示不使用流式编码
+	Eigen::MatrixXf shared_dictionary; // 预训练的共享字典，为空时对每个网格单独求字典
+	uint64_t shared_dictionary_hash = 0; // 共享字典文件的哈希
+	float target_rms_error = 0.0f; // 重建高度的均方根误差目标，0表示不使用
+	float target_energy = 0.0f; // 保留的奇异值能量占比目标，0表示不使用
+	int masked_iterations = 0; // 按掩码加权的ALS迭代次数，0表示不使用
+	int sparsity = 0; // 稀疏编码时每个patch最多使用的原子数，0表示使用SVD的稠密编码
+	int sparse_atoms = 64; // 稀疏编码的过完备字典大小
+	int sparse_iterations = 10; // 稀疏编码字典更新的迭代次数
+	int clusters = 1; // 特征聚类数，每类使用单独的字典
+	int cluster_iterations = 20; // k-means的最大迭代次数
 	int float_precision = 4; // 序列化时保存小数点后几位，可以根据原始obj文件确定
+	FileFormat file_format = FileFormat::Text;
+	float quantization_error = 0.0f; // 二进制格式中编码量化的高度均方根误差目标，0表示不量化
+	bool entropy_coding = false; // 二进制格式中各段是否再经过rANS熵编码
+	bool progressive = false; // 二进制格式按原子分层保存字典和编码，稀疏编码时不使用
 	int patch_num; // patch数量
+	ThreadPool thread_pool; // 线程池，线程数为1时所有步骤串行执行
+	bool deterministic = false; // 确定性模式，压缩结果与线程数无关
+	std::optional<Config> init_config; // init时的配置，check中用来构造其他线程数的Compressor
+	int seed_batch = 4; // 并行划分patch时每轮同时生长的patch数
+	bool verbose = false; // 输出额外的诊断信息
 	
 	// 原始数据
 	const std::vector<Eigen::Vector3f>* origin_vertices; // 顶点坐标
 	const std::vector<Eigen::Vector3f>* origin_normals; // 法线方向
 	const std::vector<std::vector<int>>* origin_faces; // 三角形面
 
-	// 顶点和边
-	std::unordered_map<int, std::unordered_map<int, std::vector<float>>> edge_parameter; // 边的参数(0-距离，1-曲率)
+	// 顶点和边，邻接表用CSR格式存储：顶点i的邻居为adjacency_vertex[adjacency_offset[i], adjacency_offset[i + 1])
+	std::vector<int> adjacency_offset; // 每个顶点邻居列表的起始位置，长度为顶点数+1
+	std::vector<int> adjacency_vertex; // 邻居顶点，每个顶点的邻居按顶点号升序排列
+	std::vector<float> edge_length; // 边的参数：距离，与adjacency_vertex一一对应
+	std::vector<float> edge_curvature; // 边的参数：曲率，与adjacency_vertex一一对应
 	std::vector<float> vertex_curvature; // 顶点的曲率
 	std::vector<int> vertex_to_patch;
 	std::vector<int> vertex_to_grid;
@@ -45,31 +105,98 @@ private:
 	std::vector<Eigen::MatrixXf> patch_featuress; // 特征
 	std::vector<Eigen::MatrixXf> patch_dictionaries; // 字典
 	std::vector<Eigen::MatrixXf> patch_codes; // 编码
+	// 稀疏编码，CSR格式：第j列的非零项为index/value[offset[j], offset[j + 1])
+	struct SparseCode {
+		std::vector<int> offset; // 每列非零项的起始位置，长度为列数+1
+		std::vector<int> index; // 非零项所在的行，即使用的字典原子
+		std::vector<float> value; // 非零项的值
+	};
+	std::vector<SparseCode> patch_sparse_codes; // 稀疏编码，与patch_dictionaries一一对应，仅sparsity > 0时使用
 	std::vector<int> patch_atoms; // 算子数
+	std::vector<int> patch_cluster; // patch所属的聚类，即patch_featuress、patch_dictionaries和patch_codes的下标
 	std::vector<std::vector<int>> patch_masks; // patch网格的掩码，位置为0表示该位置对应网格中不包含顶点，该网格的高度值无实际意义
 	std::vector<float> patch_grid_span; // patch网格的尺寸
 	std::vector<Eigen::Vector2f> patch_seed_bias; // 采样网格的位移
-	std::vector<std::set<std::vector<int>>> patch_faces; // patch包含的面，每个顶点用"patch号/grid号"表示
+	// 连接性，每个顶点的"patch号/grid号"打包为64位键：patch号 << 32 | (grid号 + 1)，键的大小顺序与(patch号, grid号)的字典序一致
+	// 各类面排序去重后存为扁平数组，按patch分组的用CSR格式：patch_id的面为patch_faces[patch_face_offset[patch_id], patch_face_offset[patch_id + 1])
+	std::vector<std::array<uint64_t, 2>> patch_faces; // patch内的面：{(patch, grid0)的键, (grid1 + 1) << 32 | (grid2 + 1)}
+	std::vector<int> patch_face_offset; // 长度为patch数+1
 	std::vector<std::vector<int>> patch_origin_faces; // 调试用变量，记录patch所包含的面号，每个面用origin_faces里的下标表示
 	std::vector<int> patch_size; // 调试用变量，记录patch所包含的顶点数
 
 
+	// 重采样时每个线程复用的缓存
+	struct ResampleScratch {
+		std::vector<float> grid_height_sum; // 每个grid内顶点高度之和，仅通用尺寸的GridKernel使用
+		std::vector<int> grid_vertex_count; // 每个grid内的顶点数，仅通用尺寸的GridKernel使用
+		std::vector<float> x, y, z; // patch内顶点(不含seed)的坐标，SoA格式，先存世界坐标，原地变换为局部坐标
+		std::vector<int> grid_index; // patch内顶点(不含seed)所在的grid
+	};
+
 	// 其他
-	std::vector<std::set<std::vector<int>>> bi_crackfaces; // 缝隙面，有两个顶点属于相同patch
-	std::set<std::vector<std::vector<int>>> tri_crackfaces; // 缝隙面，三个顶点均属于不同patch
+	std::vector<std::array<uint64_t, 3>> bi_crackfaces; // 缝隙面，有两个顶点属于相同patch：{(patch, grid0)的键, (grid1 + 1) << 32 | 另一patch号, 另一grid号 + 1}
+	std::vector<int> bi_crackface_offset; // 按相同的patch分组，长度为patch数+1
+	std::vector<std::array<uint64_t, 3>> tri_crackfaces; // 缝隙面，三个顶点均属于不同patch：三个顶点的键，升序
 
 	// 划分patches
 	void generate_patches();
+	// 从vertex_rank中依次选取seed，逐个生成patch
+	void grow_patches_serially(const std::vector<int>& vertex_rank, std::vector<char>& covered);
+	// 每轮选取一批相距足够远的seed，多线程同时生成patch
+	void grow_patches_concurrently(const std::vector<int>& vertex_rank, std::vector<char>& covered);
+	// 按seed坐标的Morton码重新编号patch，改写patch_vertices和vertex_to_patch，之后的步骤都使用新的编号
+	void reorder_patches();
 	// 进行重采样，返回patch特征(高度值数组)
 	void resample(); // 直角坐标采样
-	// 基于svd分解对特征进行编码
-	static void coding(const Eigen::MatrixXf& feature, Eigen::MatrixXf& dictionary, Eigen::MatrixXf& code, int _atoms);
+	// 为重采样准备patch信息和每个线程的缓存
+	void prepare_resample(std::vector<ResampleScratch>& scratches);
+	// 对[first, last)内的patch重采样，第patch_id个patch的高度写入height的第patch_id - first列
+	void resample_range(int first, int last, std::vector<ResampleScratch>& scratches, Eigen::MatrixXf& height);
+	// 对单个patch重采样，高度写入height指向的N_bins * N_bins个连续float，同时记录掩码、网格尺寸、偏移和顶点所属的grid
+	// Kernel为GridKernel<BINS>，由dispatch_grid_kernel按N_bins选择
+	template <typename Kernel>
+	void resample_patch(const Kernel& kernel, int patch_id, ResampleScratch& scratch, float* height);
+	// 用k-means把特征矩阵按列分为clusters类，patch_featuress替换为每类的特征矩阵
+	void cluster_features();
+	// 基于svd分解对特征进行编码，分解方法由svd_backend决定
+	void coding(const Eigen::MatrixXf& feature, Eigen::MatrixXf& dictionary, Eigen::MatrixXf& code, int _atoms);
+	// 流式编码：分块重采样，第一遍累加Gram矩阵求字典，第二遍重新采样并投影得到编码，不保存完整的特征矩阵
+	// 使用共享字典时跳过第一遍
+	void streaming_coding(int _atoms);
+	// 检查算子数，<= 0或超过秩时调整
+	int adjust_atoms(int _atoms, int rows, int cols);
+	// 把特征矩阵的Gram矩阵F * F^T累加到gram上
+	void accumulate_gram(const Eigen::Ref<const Eigen::MatrixXf>& feature, Eigen::MatrixXd& gram);
+	// 对Gram矩阵做特征值分解，按误差目标在前_atoms个特征向量中选取字典，elements为特征矩阵的元素个数
+	Eigen::MatrixXf gram_dictionary(const Eigen::MatrixXd& gram, int _atoms, double elements);
+	// 根据从大到小排列的奇异值平方energy选取满足误差目标的最小算子数，不超过_atoms，并输出预测的重建误差
+	// total_energy为特征矩阵所有元素的平方和，elements为元素个数
+	int select_atoms(const Eigen::VectorXd& energy, double total_energy, double elements, int _atoms);
+	// 掩码加权的交替最小二乘：以coding的结果为初值，只拟合有顶点的网格，column_patch为特征矩阵各列对应的patch号
+	void masked_coding(const Eigen::MatrixXf& feature, const std::vector<int>& column_patch, Eigen::MatrixXf& dictionary, Eigen::MatrixXf& code);
+	// 稀疏编码：交替进行Batch OMP和MOD字典更新，得到过完备字典和每列最多sparsity个非零项的编码
+	void sparse_coding(const Eigen::MatrixXf& feature, Eigen::MatrixXf& dictionary, SparseCode& code);
+	// 用Batch OMP对所有列求稀疏编码，字典的列须已单位化，返回重建的均方根误差
+	double sparse_pursuit(const Eigen::MatrixXf& feature, const Eigen::MatrixXf& dictionary, SparseCode& code);
+	// 单个信号的Batch OMP，gram为字典的Gram矩阵D^T * D，alpha0为D^T * x，结果追加到index和value
+	static void batch_omp(const Eigen::MatrixXf& gram, const Eigen::VectorXf& alpha0, int max_nonzeros,
+		std::vector<int>& index, std::vector<float>& value);
+	// 随机SVD：只求前_atoms个奇异向量
+	void randomized_coding(const Eigen::MatrixXf& feature, Eigen::MatrixXf& dictionary, Eigen::MatrixXf& code, int _atoms);
 	// 记录连接性信息
 	void record_connection();
-	// 序列化
+	// 序列化，按file_format选择格式
 	void serialize(std::string save_path);
-	// 生成边参数
+	// 文本格式
+	void serialize_text(const std::string& save_path);
+	// 二进制格式
+	void serialize_binary(const std::string& save_path);
+	// 用解码端得到的字典和编码还原每个patch的顶点，求包围球(球心, 半径)
+	void compute_patch_bounds(const std::vector<Eigen::MatrixXf>& dictionaries, const std::vector<Eigen::MatrixXf>& codes, std::vector<Eigen::Vector4f>& bounds);
+	// 生成CSR邻接表和边参数
 	void generate_edge_parameter();
+	// 执行算法并保存编码文件，不运行check，供compress_and_save和check中构造的Compressor使用
+	void compress(int _atoms, const std::string& save_path);
 	// 用于检查中间变量的内部函数
 	void check(int part);
 };
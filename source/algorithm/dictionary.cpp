@@ -0,0 +1,113 @@
+﻿#include "dictionary.h"
+
+#include <algorithm/compressor.h>
+#include <tools/hash.h>
+#include <tools/load_obj_mesh.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+SharedDictionary::SharedDictionary() {
+}
+
+SharedDictionary::~SharedDictionary() {
+}
+
+bool SharedDictionary::train(const std::string& corpus_path, const Config& config) {
+	// 按文件名排序，保证训练结果与目录遍历顺序无关
+	std::vector<std::string> mesh_paths;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(corpus_path, error)) {
+		if (entry.is_regular_file() && entry.path().extension() == ".obj") {
+			mesh_paths.push_back(entry.path().string());
+		}
+	}
+	if (error || mesh_paths.empty()) {
+		std::cout << "ERROR: 训练目录中没有obj网格" << std::endl;
+		return false;
+	}
+	std::sort(mesh_paths.begin(), mesh_paths.end());
+
+	// 逐个网格划分patch、重采样，把所有patch特征的Gram矩阵累加在一起，特征矩阵用完即释放
+	int rows = config.N_bins * config.N_bins;
+	Eigen::MatrixXd gram = Eigen::MatrixXd::Zero(rows, rows);
+	long long patches = 0;
+	for (const auto& path : mesh_paths) {
+		std::vector<Eigen::Vector3f> vertices, normals;
+		std::vector<std::vector<int>> faces;
+		std::vector<float> vertex_data, color_data;
+		ObjLoader obj_loader;
+		obj_loader.init(&vertices, &faces, &normals, &vertex_data, &color_data);
+		if (!obj_loader.load_obj_mesh(path)) {
+			std::cout << "ERROR: 加载网格出错 " << path << std::endl;
+			continue;
+		}
+		Compressor compressor;
+		compressor.init(&vertices, &faces, &normals, config);
+		patches += compressor.accumulate_training_gram(gram);
+	}
+	if (patches == 0) {
+		std::cout << "ERROR: 训练网格中没有patch" << std::endl;
+		return false;
+	}
+
+	// 与Compressor的gram分解方法相同，atoms <= 0时保留全部特征向量，压缩时可以只取前若干列
+	int atoms = config.atoms <= 0 ? rows : std::min(config.atoms, rows);
+	Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(gram);
+	dictionary = eigen_solver.eigenvectors().rightCols(atoms).rowwise().reverse().cast<float>();
+	double kept = eigen_solver.eigenvalues().tail(atoms).cwiseMax(0.0).sum();
+	double total = std::max(gram.trace(), std::numeric_limits<double>::min());
+	std::cout << "LOG: 共享字典训练完成，网格数 " << mesh_paths.size() << "，patch数 " << patches << "，算子数 " << atoms
+		<< "，训练集均方根误差 " << std::sqrt(std::max(total - kept, 0.0) / (double(rows) * patches))
+		<< "，保留能量占比 " << kept / total << std::endl;
+	return true;
+}
+
+bool SharedDictionary::save(const std::string& save_path) {
+	std::ofstream outfile(save_path);
+	if (!outfile.is_open()) {
+		std::cout << "ERROR: 保存路径错误" << std::endl;
+		return false;
+	}
+	// 第一行为特征长度和算子数，之后每行是字典的一行，保留float的全部有效数字
+	outfile << dictionary.rows() << ' ' << dictionary.cols() << std::endl;
+	outfile << std::setprecision(std::numeric_limits<float>::max_digits10);
+	for (int row = 0; row < dictionary.rows(); ++row) {
+		for (int col = 0; col < dictionary.cols() - 1; ++col) {
+			outfile << dictionary(row, col) << ' ';
+		}
+		outfile << dictionary(row, dictionary.cols() - 1) << std::endl;
+	}
+	outfile.close();
+	hash = fnv1a_hash_file(save_path);
+	std::cout << "LOG: 共享字典哈希 " << std::hex << hash << std::dec << std::endl;
+	return true;
+}
+
+bool SharedDictionary::load(const std::string& load_path) {
+	std::ifstream infile(load_path);
+	if (!infile.is_open()) {
+		std::cout << "ERROR: 读取路径错误" << std::endl;
+		return false;
+	}
+	int rows, cols;
+	infile >> rows >> cols;
+	dictionary.resize(rows, cols);
+	for (int row = 0; row < rows; ++row) {
+		for (int col = 0; col < cols; ++col) {
+			infile >> dictionary(row, col);
+		}
+	}
+	if (!infile) {
+		std::cout << "ERROR: 共享字典文件不完整" << std::endl;
+		hash = 0;
+		return false;
+	}
+	infile.close();
+	hash = fnv1a_hash_file(load_path);
+	return true;
+}
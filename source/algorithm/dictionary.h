@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include <core/core.h>
+#include <core/data.h>
+#include <cstdint>
+#include <string>
+
+// 预训练的共享字典：在一批风格相近的网格上训练一次，压缩时只需投影，压缩文件通过哈希引用字典文件
+class SharedDictionary {
+public:
+	SharedDictionary();
+	~SharedDictionary();
+
+	Eigen::MatrixXf dictionary; // N_bins * N_bins行，列按奇异值从大到小排列
+	uint64_t hash = 0; // 字典文件的FNV-1a哈希，0表示没有可用的字典
+
+	// 在corpus_path目录下的所有obj网格上训练字典，patch划分和重采样参数取自config
+	bool train(const std::string& corpus_path, const Config& config);
+	// 保存字典文件并更新哈希
+	bool save(const std::string& save_path);
+	// 读取字典文件并计算哈希
+	bool load(const std::string& load_path);
+};
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <algorithm/local_frame.h>
+
+// 重采样和还原时与网格相关的计算。BINS > 0时网格边长是编译期常量，循环可以展开，网格数组直接放在栈上；
+// BINS == 0是通用版本，使用运行时的N_bins。常用的N_bins通过dispatch_grid_kernel选择对应的特化版本
+template <int BINS>
+class GridKernel {
+public:
+	explicit GridKernel(int _N_bins) : runtime_bins(_N_bins) {}
+
+	int bins() const { return BINS > 0 ? BINS : runtime_bins; }
+	int cells() const { return bins() * bins(); }
+
+	// 批量计算局部坐标所在的grid号
+	void grid_index(const float* x, const float* y, int n, float origin_x, float origin_y, float base, float span, int* grid) const {
+		compute_grid_index<BINS>(x, y, n, origin_x, origin_y, base, span, bins(), grid);
+	}
+
+	// 把n个顶点的高度按grid求平均写入height(长度为cells())，有顶点的grid按升序追加到mask
+	// 通用版本使用调用方提供的sum和count缓存(长度至少为cells())，特化版本使用栈上的数组
+	void average_height(const int* grid, const float* z, int n, float* sum, int* count, float* height, std::vector<int>& mask) const {
+		if constexpr (BINS > 0) {
+			float fixed_sum[BINS * BINS] = {};
+			int fixed_count[BINS * BINS] = {};
+			accumulate(grid, z, n, fixed_sum, fixed_count, height, mask);
+		}
+		else {
+			std::fill(sum, sum + cells(), 0.0f);
+			std::fill(count, count + cells(), 0);
+			accumulate(grid, z, n, sum, count, height, mask);
+		}
+	}
+
+	// 由grid号计算grid中心的局部xy坐标
+	void grid_center(const int* grid, int n, float span, float bias_x, float bias_y, float* x, float* y) const {
+		float base = -span * bins() / 2.0f;
+		for (int i = 0; i < n; ++i) {
+			int grid_y = grid[i] / bins();
+			int grid_x = grid[i] % bins();
+			x[i] = base + (grid_x + 0.5f) * span + bias_x;
+			y[i] = base + (grid_y + 0.5f) * span + bias_y;
+		}
+	}
+
+private:
+	int runtime_bins;
+
+	void accumulate(const int* grid, const float* z, int n, float* sum, int* count, float* height, std::vector<int>& mask) const {
+		for (int i = 0; i < n; ++i) {
+			sum[grid[i]] += z[i];
+			count[grid[i]] += 1;
+		}
+		for (int cell = 0; cell < cells(); ++cell) {
+			if (count[cell] > 0) {
+				height[cell] = sum[cell] / count[cell];
+				mask.push_back(cell);
+			}
+		}
+	}
+};
+
+// 按运行时的N_bins选择特化版本并调用func(kernel)，其他尺寸使用通用版本
+template <typename Func>
+void dispatch_grid_kernel(int N_bins, Func&& func) {
+	switch (N_bins) {
+	case 8: func(GridKernel<8>(N_bins)); break;
+	case 10: func(GridKernel<10>(N_bins)); break;
+	case 12: func(GridKernel<12>(N_bins)); break;
+	case 16: func(GridKernel<16>(N_bins)); break;
+	default: func(GridKernel<0>(N_bins)); break;
+	}
+}
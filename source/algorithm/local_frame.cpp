@@ -0,0 +1,87 @@
+﻿#include "local_frame.h"
+
+// 只用SSE2：x64的MSVC默认即可使用，工程没有开启/arch:AVX2，AVX2分支不会被编译
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LOCAL_FRAME_SSE2
+#endif
+
+LocalFrame LocalFrame::from_transform(const Eigen::Matrix4f& transform) {
+	LocalFrame frame;
+	frame.rotation = transform.topLeftCorner<3, 3>();
+	frame.translation = transform.topRightCorner<3, 1>();
+	return frame;
+}
+
+LocalFrame LocalFrame::inverse() const {
+	LocalFrame frame;
+	frame.rotation = rotation.transpose(); // 旋转矩阵正交，逆即转置
+	frame.translation = -(frame.rotation * translation);
+	return frame;
+}
+
+void transform_points_scalar(const LocalFrame& frame, const float* in_x, const float* in_y, const float* in_z, int n,
+	float* out_x, float* out_y, float* out_z) {
+	const Eigen::Matrix3f& r = frame.rotation;
+	const Eigen::Vector3f& t = frame.translation;
+	for (int i = 0; i < n; ++i) {
+		float x = in_x[i], y = in_y[i], z = in_z[i];
+		out_x[i] = r(0, 0) * x + r(0, 1) * y + r(0, 2) * z + t[0];
+		out_y[i] = r(1, 0) * x + r(1, 1) * y + r(1, 2) * z + t[1];
+		out_z[i] = r(2, 0) * x + r(2, 1) * y + r(2, 2) * z + t[2];
+	}
+}
+
+void transform_points(const LocalFrame& frame, const float* in_x, const float* in_y, const float* in_z, int n,
+	float* out_x, float* out_y, float* out_z) {
+	const Eigen::Matrix3f& r = frame.rotation;
+	const Eigen::Vector3f& t = frame.translation;
+	int i = 0;
+	// 向量化部分不使用FMA，运算顺序与标量实现相同，编译器不把标量乘加合并为FMA时两者结果逐位一致
+#if defined(LOCAL_FRAME_SSE2)
+	__m128 r00 = _mm_set1_ps(r(0, 0)), r01 = _mm_set1_ps(r(0, 1)), r02 = _mm_set1_ps(r(0, 2)), t0 = _mm_set1_ps(t[0]);
+	__m128 r10 = _mm_set1_ps(r(1, 0)), r11 = _mm_set1_ps(r(1, 1)), r12 = _mm_set1_ps(r(1, 2)), t1 = _mm_set1_ps(t[1]);
+	__m128 r20 = _mm_set1_ps(r(2, 0)), r21 = _mm_set1_ps(r(2, 1)), r22 = _mm_set1_ps(r(2, 2)), t2 = _mm_set1_ps(t[2]);
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(in_x + i), y = _mm_loadu_ps(in_y + i), z = _mm_loadu_ps(in_z + i);
+		__m128 lx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, x), _mm_mul_ps(r01, y)), _mm_mul_ps(r02, z)), t0);
+		__m128 ly = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, x), _mm_mul_ps(r11, y)), _mm_mul_ps(r12, z)), t1);
+		__m128 lz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r20, x), _mm_mul_ps(r21, y)), _mm_mul_ps(r22, z)), t2);
+		_mm_storeu_ps(out_x + i, lx);
+		_mm_storeu_ps(out_y + i, ly);
+		_mm_storeu_ps(out_z + i, lz);
+	}
+#endif
+	// 剩余不足一个向量宽度的点
+	transform_points_scalar(frame, in_x + i, in_y + i, in_z + i, n - i, out_x + i, out_y + i, out_z + i);
+}
+
+template <int BINS>
+void compute_grid_index(const float* x, const float* y, int n, float origin_x, float origin_y, float base, float span, int N_bins, int* grid) {
+	if (BINS > 0) N_bins = BINS;
+	int i = 0;
+#if defined(LOCAL_FRAME_SSE2)
+	__m128 ox = _mm_set1_ps(origin_x), oy = _mm_set1_ps(origin_y), b = _mm_set1_ps(base), s = _mm_set1_ps(span);
+	for (; i + 4 <= n; i += 4) {
+		__m128i gx = _mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(x + i), ox), b), s));
+		__m128i gy = _mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(y + i), oy), b), s));
+		alignas(16) int gx_lane[4], gy_lane[4]; // SSE2没有32位整数乘法，行号乘N_bins在标量中完成
+		_mm_store_si128(reinterpret_cast<__m128i*>(gx_lane), gx);
+		_mm_store_si128(reinterpret_cast<__m128i*>(gy_lane), gy);
+		for (int lane = 0; lane < 4; ++lane) {
+			grid[i + lane] = N_bins * gy_lane[lane] + gx_lane[lane];
+		}
+	}
+#endif
+	for (; i < n; ++i) {
+		int x_grid = (x[i] - origin_x - base) / span;
+		int y_grid = (y[i] - origin_y - base) / span;
+		grid[i] = N_bins * y_grid + x_grid;
+	}
+}
+
+template void compute_grid_index<0>(const float*, const float*, int, float, float, float, float, int, int*);
+template void compute_grid_index<8>(const float*, const float*, int, float, float, float, float, int, int*);
+template void compute_grid_index<10>(const float*, const float*, int, float, float, float, float, int, int*);
+template void compute_grid_index<12>(const float*, const float*, int, float, float, float, float, int, int*);
+template void compute_grid_index<16>(const float*, const float*, int, float, float, float, float, int, int*);
@@ -0,0 +1,26 @@
+﻿#pragma once
+
+#include <core/core.h>
+
+// patch局部坐标系，local = rotation * world + translation，与Compressor::generate_transform生成的矩阵等价
+struct LocalFrame {
+	Eigen::Matrix3f rotation;
+	Eigen::Vector3f translation;
+
+	// 从齐次变换矩阵中取出旋转和平移，最后一行必须是(0, 0, 0, 1)
+	static LocalFrame from_transform(const Eigen::Matrix4f& transform);
+	// 逆变换，world = rotation^T * (local - translation)
+	LocalFrame inverse() const;
+};
+
+// 批量变换一组SoA格式的点：out = rotation * in + translation，输入和输出可以是同一块内存
+// x64上使用SSE2，否则退化为标量实现
+void transform_points(const LocalFrame& frame, const float* in_x, const float* in_y, const float* in_z, int n,
+	float* out_x, float* out_y, float* out_z);
+// 标量实现，用于对照和基准测试
+void transform_points_scalar(const LocalFrame& frame, const float* in_x, const float* in_y, const float* in_z, int n,
+	float* out_x, float* out_y, float* out_z);
+// 批量计算局部坐标所在的grid号：grid = N_bins * int((y - origin_y - base) / span) + int((x - origin_x - base) / span)
+// BINS > 0时N_bins取编译期常量BINS，已实例化8、10、12、16和通用版本0
+template <int BINS>
+void compute_grid_index(const float* x, const float* y, int n, float origin_x, float origin_y, float base, float span, int N_bins, int* grid);
@@ -1,6 +1,15 @@
 ﻿#include "parser.h"
 
+#include <algorithm/binary_format.h>
 #include <algorithm/compressor.h>
+#include <algorithm/grid_kernel.h>
+#include <algorithm/local_frame.h>
+#include <algorithm/quantizer.h>
+#include <tools/binary_io.h>
+#include <tools/bit_ops.h>
+#include <tools/rans.h>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -10,57 +19,237 @@ Parser::Parser() {
 Parser::~Parser() {
 }
 
-void Parser::map_grid_to_vertex(int patch, int grid, const Eigen::Vector3f& cord) {
-	grid_to_vertex[{patch, grid}] = vertices->size();
-	vertices->push_back(cord);
-	vertex_to_patch.push_back(patch);
+void Parser::init_masks(CompressedData& data) {
+	data.mask_words = std::max((N_bins * N_bins + 63) / 64, 1);
+	data.mask_bits.assign(size_t(patch_num) * data.mask_words, 0);
+}
+
+bool Parser::set_mask_bit(CompressedData& data, int patch, int grid) {
+	if (grid < 0 || grid >= N_bins * N_bins) {
+		std::cout << "ERROR: 掩码中的grid号超出范围" << std::endl;
+		return false;
+	}
+	data.mask_bits[size_t(patch) * data.mask_words + grid / 64] |= 1ull << (grid % 64);
+	return true;
 }
 
 void Parser::parse(std::string load_path) {
-	std::ifstream infile(load_path);
-	if (!infile.is_open()) {
+	parse(load_path, 0);
+}
+
+void Parser::parse(std::string load_path, int max_atoms) {
+	parse_selected(load_path, max_atoms, [&](const CompressedData&, std::vector<char>& selected) {
+		selected.assign(patch_num, 1);
+		return true;
+	});
+}
+
+void Parser::parse_patches(std::string load_path, const std::vector<int>& patches) {
+	parse_selected(load_path, 0, [&](const CompressedData&, std::vector<char>& selected) {
+		selected.assign(patch_num, 0);
+		for (int patch_index : patches) {
+			if (patch_index < 0 || patch_index >= patch_num) {
+				std::cout << "ERROR: patch号" << patch_index << "超出范围" << std::endl;
+				return false;
+			}
+			selected[patch_index] = 1;
+		}
+		return true;
+	});
+}
+
+void Parser::parse_region(std::string load_path, const Eigen::AlignedBox3f& box) {
+	parse_selected(load_path, 0, [&](const CompressedData& data, std::vector<char>& selected) {
+		if (data.bounds.empty()) {
+			std::cout << "ERROR: 压缩文件中没有patch的包围球，不能按区域解码" << std::endl;
+			return false;
+		}
+		selected.assign(patch_num, 0);
+		for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+			const Eigen::Vector4f& bound = data.bounds[patch_index];
+			selected[patch_index] = box.squaredExteriorDistance(bound.head<3>()) <= bound[3] * bound[3];
+		}
+		return true;
+	});
+}
+
+void Parser::parse_frustum(std::string load_path, const std::vector<Eigen::Vector4f>& planes) {
+	parse_selected(load_path, 0, [&](const CompressedData& data, std::vector<char>& selected) {
+		if (data.bounds.empty()) {
+			std::cout << "ERROR: 压缩文件中没有patch的包围球，不能按区域解码" << std::endl;
+			return false;
+		}
+		selected.assign(patch_num, 0);
+		for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+			// 球心到任一平面外侧的距离超过半径时不相交，保守判断，视锥角落附近的球可能多选
+			const Eigen::Vector4f& bound = data.bounds[patch_index];
+			bool inside = true;
+			for (const auto& plane : planes) {
+				float distance = plane.head<3>().dot(bound.head<3>()) + plane[3];
+				inside = inside && distance >= -bound[3] * plane.head<3>().norm();
+			}
+			selected[patch_index] = inside;
+		}
+		return true;
+	});
+}
+
+bool Parser::refine(int max_atoms) {
+	if (!refinable) {
+		std::cout << "ERROR: 没有可以细化的mesh，需要先成功调用parse" << std::endl;
+		return false;
+	}
+	loaded.atom_limit = max_atoms > 0 ? max_atoms : std::numeric_limits<int>::max();
+	auto& levels = loaded.levels;
+	if (!levels.offset.empty()) {
+		// 被截断的文件还缺少需要的层时，重新映射文件，读取这段时间写入的层
+		int wanted = std::min(loaded.atom_limit, int(levels.offset.size()) - 1);
+		bool truncated = levels.available < levels.size && levels.offset[wanted] > levels.available;
+		if ((truncated && !remap_levels(loaded)) || !read_levels(loaded, loaded.atom_limit)) {
+			refinable = false;
+			return false;
+		}
+	}
+	decode_vertices(loaded);
+	// 面不变，只按新的顶点坐标改写坐标数组
+	for (int face_index = 0; face_index < faces->size(); ++face_index) {
+		for (int i = 0; i < 3; ++i) {
+			const Eigen::Vector3f& point = (*vertices)[(*faces)[face_index][i]];
+			std::copy(point.data(), point.data() + 3, vertex_data->begin() + (size_t(face_index) * 3 + i) * 3);
+		}
+	}
+	return true;
+}
+
+void Parser::close() {
+	loaded = CompressedData();
+	refinable = false;
+}
+
+void Parser::parse_selected(const std::string& load_path, int max_atoms, const std::function<bool(const CompressedData&, std::vector<char>&)>& select) {
+	// 二进制格式直接读取映射的文件，文本格式仍用文件流读取；读出的数据保留到下一次parse，供refine使用
+	loaded = CompressedData();
+	refinable = false;
+	CompressedData& data = loaded;
+	data.atom_limit = max_atoms > 0 ? max_atoms : std::numeric_limits<int>::max();
+	data.path = load_path;
+	if (!data.file.open(load_path)) {
 		std::cout << "ERROR: 读取路径错误" << std::endl;
 		return;
 	}
+	bool binary = BinaryFormat::match(data.file.data(), data.file.size());
+	if (!binary) data.file.close();
 
 	// 清空所有数据
 	std::vector<Eigen::Vector3f>().swap(*vertices); // 所有顶点
 	std::vector<std::vector<int>>().swap(*faces); // 所有面
 	std::vector<float>().swap(*vertex_data);
 	std::vector<float>().swap(*color_data);
-	std::vector<std::vector<std::vector<int>>>().swap(faces_on_grid);
-	std::map<std::vector<int>, int>().swap(grid_to_vertex);
+	std::vector<std::array<int, 6>>().swap(faces_on_grid);
+
+	std::vector<char> selected;
+	if ((binary ? read_binary(data) : read_text(load_path, data)) && select(data, selected)) {
+		reconstruct(data, selected);
+	}
+}
+
+const float* Parser::find_shared_dictionary(uint64_t hash, int rows, int atoms) {
+	auto it = shared_dictionaries.find(hash);
+	if (it == shared_dictionaries.end() || it->second.rows() != rows || it->second.cols() < atoms) {
+		std::cout << "ERROR: 缺少哈希为" << std::hex << hash << std::dec << "的共享字典" << std::endl;
+		return nullptr;
+	}
+	return it->second.data();
+}
+
+// 多个字典时每个patch属于一个聚类，聚类内的patch按patch号升序对应编码矩阵的各列
+static std::vector<std::vector<int>> group_cluster_patches(const std::vector<int>& patch_cluster, int total_features) {
+	std::vector<std::vector<int>> cluster_patches(total_features);
+	for (int patch_index = 0; patch_index < patch_cluster.size(); ++patch_index) {
+		cluster_patches[patch_cluster[patch_index]].push_back(patch_index);
+	}
+	return cluster_patches;
+}
+
+bool Parser::read_text(const std::string& load_path, CompressedData& data) {
+	std::ifstream infile(load_path);
+	if (!infile.is_open()) {
+		std::cout << "ERROR: 读取路径错误" << std::endl;
+		return false;
+	}
 
 	/************ 读取全局信息 ************/
 	// N_bins, patch总数
 	infile >> N_bins >> patch_num;
+	if (!infile || N_bins <= 0 || N_bins > 255 || patch_num < 0) {
+		std::cout << "ERROR: 压缩文件的N_bins或patch数损坏" << std::endl;
+		return false;
+	}
 	int feature_len = N_bins * N_bins;
+	init_masks(data);
 	infile.get();
 	// patch特征
-	std::vector<Eigen::MatrixXf> patch_dictionaries;
-	std::vector<Eigen::MatrixXf> patch_codes;
 	int total_features;
 	infile >> total_features;
+	if (!infile || total_features <= 0 || total_features > std::max(patch_num, 1)) {
+		std::cout << "ERROR: 压缩文件的特征数损坏" << std::endl;
+		return false;
+	}
+	std::vector<int> patch_cluster(patch_num, 0);
+	if (total_features > 1) {
+		for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+			infile >> patch_cluster[patch_index];
+		}
+	}
+	data.cluster_patches = group_cluster_patches(patch_cluster, total_features);
+	data.feature_sparse.assign(total_features, 0);
+	data.sparse_codes.resize(patch_num);
 	for (int i = 0; i < total_features; ++i) {
-		// 算子数
-		int atoms;
-		infile >> atoms;
+		// 算子数、每列最多的非零项数(稠密编码为0)和共享字典文件的哈希(不使用时为0)
+		int atoms, sparsity;
+		uint64_t shared_hash;
+		infile >> atoms >> sparsity >> std::hex >> shared_hash >> std::dec;
+		if (!infile || atoms < 0 || sparsity < 0) {
+			std::cout << "ERROR: 压缩文件的算子数或编码方式损坏" << std::endl;
+			return false;
+		}
+		data.feature_sparse[i] = sparsity > 0;
 		// 字典
-		Eigen::MatrixXf dictionary(feature_len, atoms);
-		for (int i = 0; i < dictionary.rows(); ++i) {
-			for (int j = 0; j < dictionary.cols(); ++j) {
-				infile >> dictionary(i, j);
+		if (shared_hash != 0) {
+			const float* shared = find_shared_dictionary(shared_hash, feature_len, atoms);
+			if (!shared) return false;
+			data.dictionaries.emplace_back(shared, feature_len, atoms);
+		}
+		else {
+			Eigen::MatrixXf dictionary(feature_len, atoms);
+			for (int i = 0; i < dictionary.rows(); ++i) {
+				for (int j = 0; j < dictionary.cols(); ++j) {
+					infile >> dictionary(i, j);
+				}
+			}
+			data.dictionaries.push_back(data.keep(std::move(dictionary)));
+		}
+		// 稀疏编码，每列为非零项数和(原子下标, 值)
+		if (data.feature_sparse[i]) {
+			for (int patch_index : data.cluster_patches[i]) {
+				int nonzeros;
+				infile >> nonzeros;
+				data.sparse_codes[patch_index].resize(nonzeros);
+				for (auto& [index, value] : data.sparse_codes[patch_index]) {
+					infile >> index >> value;
+				}
 			}
+			data.codes.emplace_back(nullptr, 0, 0);
+			continue;
 		}
-		patch_dictionaries.push_back(std::move(dictionary));
 		// 编码
-		Eigen::MatrixXf code(atoms, patch_num);
+		Eigen::MatrixXf code(atoms, data.cluster_patches[i].size());
 		for (int i = 0; i < code.rows(); ++i) {
 			for (int j = 0; j < code.cols(); ++j) {
 				infile >> code(i, j);
 			}
 		}
-		patch_codes.push_back(std::move(code));
+		data.codes.push_back(data.keep(std::move(code)));
 	}
 	infile.get();
 	// patch间连接性
@@ -73,41 +262,36 @@ void Parser::parse(std::string load_path) {
 		infile >> patch0 >> c >> grid0
 			>> patch1 >> c >> grid1
 			>> patch2 >> c >> grid2;
-		faces_on_grid.push_back({ {patch0, grid0}, {patch1, grid1}, {patch2, grid2} });
+		faces_on_grid.push_back({ patch0, grid0, patch1, grid1, patch2, grid2 });
 	}
 	infile.get();
 
 	/************ 读取patch信息 ************/
-	std::vector<Eigen::Vector3f> patch_cord; // 种子点坐标
-	std::vector<Eigen::Vector3f> patch_norm; // 种子点法线
-	std::vector<float> patch_grid_span; // patch网格的尺寸
-	std::vector<Eigen::Vector2f> patch_seed_bias; // 采样网格的位移
-	std::vector<std::vector<int>> patch_mask; // 掩码
 	for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
 		// 坐标
 		Eigen::Vector3f seed_cord;
 		infile >> seed_cord[0] >> seed_cord[1] >> seed_cord[2];
-		patch_cord.push_back(seed_cord);
+		data.seed_cord.push_back(seed_cord);
 
 		// 法线
 		Eigen::Vector3f seed_norm;
 		infile >> seed_norm[0] >> seed_norm[1] >> seed_norm[2];
-		patch_norm.push_back(seed_norm);
+		data.seed_norm.push_back(seed_norm);
 
 		// 网格尺寸和原点偏移
 		float grid_span, x_bias, y_bias;
 		infile >> grid_span >> x_bias >> y_bias;
-		patch_grid_span.push_back(grid_span);
-		patch_seed_bias.emplace_back(x_bias, y_bias);
+		data.grid_span.push_back(grid_span);
+		data.seed_bias.emplace_back(x_bias, y_bias);
 
 		// 掩码
 		int size;
 		infile >> size;
-		std::vector<int> mask(size);
 		for (int i = 0; i < size; ++i) {
-			infile >> mask[i];
+			int grid;
+			infile >> grid;
+			if (!set_mask_bit(data, patch_index, grid)) return false;
 		}
-		patch_mask.push_back(std::move(mask));
 
 		// patch内连接性
 		int face_num;
@@ -115,7 +299,7 @@ void Parser::parse(std::string load_path) {
 		for (int i = 0; i < face_num; ++i) {
 			int grid0, grid1, grid2;
 			infile >> grid0 >> grid1 >> grid2;
-			faces_on_grid.push_back({ {patch_index, grid0}, {patch_index, grid1}, {patch_index, grid2} });
+			faces_on_grid.push_back({ patch_index, grid0, patch_index, grid1, patch_index, grid2 });
 		}
 
 		// patch间连接性，但有两个顶点属于同一patch
@@ -125,82 +309,581 @@ void Parser::parse(std::string load_path) {
 			int grid0, grid1, patch2, grid2;
 			char c;
 			infile >> grid0 >> grid1 >> patch2 >> c >> grid2;
-			faces_on_grid.push_back({ {patch_index, grid0}, {patch_index, grid1}, {patch2, grid2} });
+			faces_on_grid.push_back({ patch_index, grid0, patch_index, grid1, patch2, grid2 });
 		}
 
 		infile.get();
 	}
 	infile.close();
+	return true;
+}
+
+bool Parser::read_binary(CompressedData& data) {
+	if (!is_little_endian()) {
+		std::cout << "ERROR: 二进制格式只支持小端序的主机" << std::endl;
+		return false;
+	}
+	// 映射的起点按页对齐，段和数组按alignment对齐，原样保存的数组可以直接访问
+	const char* buffer = data.file.data();
+	size_t buffer_size = data.file.size();
+	BinaryReader file(buffer, buffer_size);
+
+	// 文件头和段表
+	BinaryFormat::FileHeader header;
+	if (!file.read(header) || header.version != BinaryFormat::version || !file.seek(header.header_size) || header.section_count > 64) {
+		std::cout << "ERROR: 不支持的二进制格式版本" << std::endl;
+		return false;
+	}
+	// grid号以uint16保存，N_bins * N_bins须小于65535
+	if (header.N_bins == 0 || uint64_t(header.N_bins) * header.N_bins >= 65535 || header.patch_num > uint32_t(std::numeric_limits<int>::max())) {
+		std::cout << "ERROR: 二进制文件头中的N_bins或patch数损坏" << std::endl;
+		return false;
+	}
+	N_bins = header.N_bins;
+	patch_num = header.patch_num;
+	int feature_len = N_bins * N_bins;
+	std::map<uint32_t, BinaryReader> sections;
+	std::map<uint32_t, uint32_t> encodings;
+	auto& decoded = data.decoded_sections;
+	decoded.resize(header.section_count);
+	for (uint32_t i = 0; i < header.section_count; ++i) {
+		BinaryFormat::SectionEntry entry;
+		// Atoms段在文件最后，渐进传输中的文件可能只有前几层，允许它超出文件末尾，read_levels只解码完整的层
+		if (!file.read(entry) || entry.offset > buffer_size || (entry.size > buffer_size - entry.offset && entry.type != uint32_t(BinaryFormat::Section::Atoms))) {
+			std::cout << "ERROR: 二进制文件的段表损坏" << std::endl;
+			return false;
+		}
+		// 段内按相对文件起点的偏移对齐，段的起点已经对齐，因此可以直接用段内偏移
+		const char* section_data = buffer + entry.offset;
+		size_t section_size = std::min<uint64_t>(entry.size, buffer_size - entry.offset);
+		if (entry.type == uint32_t(BinaryFormat::Section::Atoms)) {
+			// Atoms段按层单独编码，读取时按需解码
+			data.levels.section = section_data;
+			data.levels.section_offset = entry.offset;
+			data.levels.size = entry.size;
+			data.levels.available = section_size;
+			data.levels.coded = entry.encoding & BinaryFormat::entropy_coded;
+		}
+		else if (entry.encoding & BinaryFormat::entropy_coded) {
+			if (!rans_decode(reinterpret_cast<const uint8_t*>(section_data), section_size, decoded[i], thread_pool)) {
+				std::cout << "ERROR: 二进制文件的熵编码数据损坏" << std::endl;
+				return false;
+			}
+			section_data = reinterpret_cast<const char*>(decoded[i].data());
+			section_size = decoded[i].size();
+		}
+		sections.emplace(entry.type, BinaryReader(section_data, section_size));
+		encodings[entry.type] = entry.encoding & 0xff;
+	}
+	auto section = [&](BinaryFormat::Section type) -> BinaryReader* {
+		auto it = sections.find(uint32_t(type));
+		return it == sections.end() ? nullptr : &it->second;
+	};
+	BinaryReader* features = section(BinaryFormat::Section::Features);
+	BinaryReader* codes = section(BinaryFormat::Section::Codes);
+	BinaryReader* patches = section(BinaryFormat::Section::Patches);
+	BinaryReader* masks = section(BinaryFormat::Section::Masks);
+	BinaryReader* connectivity = section(BinaryFormat::Section::Connectivity);
+	BinaryReader* levels = section(BinaryFormat::Section::Atoms);
+	if (!features || !(codes || levels) || !patches || !masks || !connectivity) {
+		std::cout << "ERROR: 二进制文件缺少必要的段" << std::endl;
+		return false;
+	}
+	// 按patch数分配内存之前先与段的大小比较，避免损坏的文件头导致巨大的分配
+	// Patches段每个patch至少占sizeof(PatchRecord)字节(Delta编码为24字节平面和12字节的网格尺寸与位移)，掩码每个patch至少占一个位图或一个int32
+	size_t mask_bytes = (feature_len + 7) / 8;
+	bool bitset_masks = encodings[uint32_t(BinaryFormat::Section::Masks)] == uint32_t(BinaryFormat::Encoding::Bitset);
+	if (size_t(patch_num) * sizeof(BinaryFormat::PatchRecord) > patches->size()
+		|| size_t(patch_num) * (bitset_masks ? mask_bytes : sizeof(int32_t)) > masks->size()) {
+		std::cout << "ERROR: 二进制文件头中的patch数与段的大小不符" << std::endl;
+		return false;
+	}
+	const size_t alignment = BinaryFormat::alignment;
+	bool quantized_dictionary = encodings[uint32_t(BinaryFormat::Section::Features)] == uint32_t(BinaryFormat::Encoding::Quantized);
+	bool quantized_code = encodings[uint32_t(BinaryFormat::Section::Codes)] == uint32_t(BinaryFormat::Encoding::Quantized);
+	data.levels.quantized = encodings[uint32_t(BinaryFormat::Section::Atoms)] == uint32_t(BinaryFormat::Encoding::Quantized);
+	std::vector<float> offset, step;
+	// 读取量化数据的offset和step
+	auto read_quantization = [&](BinaryReader* reader, int count) {
+		offset.resize(count);
+		step.resize(count);
+		reader->align(alignment);
+		reader->read_array(offset.data(), count);
+		reader->align(alignment);
+		reader->read_array(step.data(), count);
+		reader->align(alignment);
+	};
+
+	// 聚类
+	uint32_t total_features = 0;
+	if (!features->read(total_features) || total_features == 0 || total_features > uint32_t(std::max(patch_num, 1))) {
+		std::cout << "ERROR: 二进制文件的特征数损坏" << std::endl;
+		return false;
+	}
+	std::vector<int> patch_cluster(patch_num, 0);
+	if (total_features > 1) {
+		BinaryReader* clusters = section(BinaryFormat::Section::Clusters);
+		if (!clusters || !clusters->read_array(patch_cluster.data(), patch_num)) {
+			std::cout << "ERROR: 二进制文件缺少聚类信息" << std::endl;
+			return false;
+		}
+		for (int cluster : patch_cluster) {
+			if (cluster < 0 || cluster >= int(total_features)) {
+				std::cout << "ERROR: 二进制文件的聚类信息损坏" << std::endl;
+				return false;
+			}
+		}
+	}
+	data.cluster_patches = group_cluster_patches(patch_cluster, total_features);
+	data.feature_sparse.assign(total_features, 0);
+	data.sparse_codes.resize(patch_num);
 
+	// 字典和编码
+	for (uint32_t i = 0; i < total_features; ++i) {
+		BinaryFormat::FeatureHeader feature;
+		features->align(alignment);
+		features->read(feature);
+		if (!features->good() || feature.rows != feature_len || feature.atoms < 0 || feature.columns != int(data.cluster_patches[i].size())) {
+			std::cout << "ERROR: 二进制文件的特征信息损坏" << std::endl;
+			return false;
+		}
+		if (levels) {
+			// 渐进布局：字典和编码在Atoms段中按层保存，先分配全0的矩阵，read_levels逐层填入
+			if (feature.sparsity > 0) {
+				std::cout << "ERROR: 渐进布局不支持稀疏编码" << std::endl;
+				return false;
+			}
+			if (feature.shared_hash != 0) {
+				const float* shared = find_shared_dictionary(feature.shared_hash, feature.rows, feature.atoms);
+				if (!shared) return false;
+				data.dictionaries.emplace_back(shared, feature.rows, feature.atoms);
+				data.levels.dictionaries.push_back(nullptr);
+			}
+			else {
+				data.dictionaries.push_back(data.keep(Eigen::MatrixXf::Zero(feature.rows, feature.atoms)));
+				data.levels.dictionaries.push_back(data.storage.back().data());
+			}
+			data.codes.push_back(data.keep(Eigen::MatrixXf::Zero(feature.atoms, feature.columns)));
+			data.levels.codes.push_back(data.storage.back().data());
+			continue;
+		}
+		if (feature.shared_hash != 0) {
+			const float* shared = find_shared_dictionary(feature.shared_hash, feature.rows, feature.atoms);
+			if (!shared) return false;
+			data.dictionaries.emplace_back(shared, feature.rows, feature.atoms);
+		}
+		else if (quantized_dictionary) {
+			read_quantization(features, feature.atoms);
+			size_t column_bytes = quantized_bytes(feature.rows, 16);
+			size_t stream_bytes = column_bytes * feature.atoms;
+			const uint8_t* stream;
+			features->view_array(stream, stream_bytes);
+			Eigen::MatrixXf dictionary(feature.rows, feature.atoms);
+			for (int k = 0; k < feature.atoms && features->good(); ++k) {
+				dequantize(stream + column_bytes * k, stream_bytes - column_bytes * k, feature.rows, 16, offset[k], step[k], dictionary.col(k).data());
+			}
+			data.dictionaries.push_back(data.keep(std::move(dictionary)));
+		}
+		else {
+			const float* dictionary;
+			features->align(alignment);
+			features->view_array(dictionary, size_t(feature.rows) * feature.atoms);
+			data.dictionaries.emplace_back(dictionary, feature.rows, feature.atoms);
+		}
+		data.feature_sparse[i] = feature.sparsity > 0;
+		if (data.feature_sparse[i]) {
+			const int *offset, *index;
+			const float* value;
+			codes->align(alignment);
+			codes->view_array(offset, feature.columns + 1);
+			codes->align(alignment);
+			codes->view_array(index, feature.nonzeros);
+			codes->align(alignment);
+			codes->view_array(value, feature.nonzeros);
+			for (int j = 0; j < feature.columns && codes->good(); ++j) {
+				if (offset[j] < 0 || offset[j] > offset[j + 1] || offset[j + 1] > int(feature.nonzeros)) {
+					std::cout << "ERROR: 二进制文件的稀疏编码损坏" << std::endl;
+					return false;
+				}
+				auto& column = data.sparse_codes[data.cluster_patches[i][j]];
+				for (int k = offset[j]; k < offset[j + 1]; ++k) {
+					column.emplace_back(index[k], value[k]);
+				}
+			}
+			data.codes.emplace_back(nullptr, 0, 0);
+		}
+		else if (quantized_code) {
+			// 按行量化，先解码到转置矩阵中使每行连续
+			read_quantization(codes, feature.atoms);
+			const uint8_t* bits;
+			codes->view_array(bits, feature.atoms);
+			size_t stream_bytes = 0;
+			for (int k = 0; k < feature.atoms && codes->good(); ++k) {
+				if (bits[k] > 24) {
+					std::cout << "ERROR: 二进制文件的量化位数损坏" << std::endl;
+					return false;
+				}
+				stream_bytes += quantized_bytes(feature.columns, bits[k]);
+			}
+			const uint8_t* stream;
+			codes->align(alignment);
+			codes->view_array(stream, stream_bytes);
+			Eigen::MatrixXf code_transpose(feature.columns, feature.atoms);
+			size_t position = 0;
+			for (int k = 0; k < feature.atoms && codes->good(); ++k) {
+				dequantize(stream + position, stream_bytes - position, feature.columns, bits[k], offset[k], step[k], code_transpose.col(k).data());
+				position += quantized_bytes(feature.columns, bits[k]);
+			}
+			data.codes.push_back(data.keep(code_transpose.transpose()));
+		}
+		else {
+			const float* code;
+			codes->align(alignment);
+			codes->view_array(code, size_t(feature.atoms) * feature.columns);
+			data.codes.emplace_back(code, feature.atoms, feature.columns);
+		}
+	}
+
+	// seed、网格尺寸和偏移
+	if (encodings[uint32_t(BinaryFormat::Section::Patches)] == uint32_t(BinaryFormat::Encoding::Delta)) {
+		// 从字节平面拼出seed坐标和法线位模式的差分，逐个patch累加还原
+		const uint8_t* planes;
+		patches->view_array(planes, size_t(patch_num) * 24);
+		uint32_t previous[6] = {};
+		float components[6];
+		for (int patch_index = 0; patch_index < patch_num && patches->good(); ++patch_index) {
+			for (int k = 0; k < 6; ++k) {
+				uint32_t delta = 0;
+				for (int j = 0; j < 4; ++j) {
+					delta |= uint32_t(planes[size_t(k * 4 + j) * patch_num + patch_index]) << (j * 8);
+				}
+				previous[k] += uint32_t(zigzag_decode(delta));
+				std::memcpy(&components[k], &previous[k], sizeof(float));
+			}
+			data.seed_cord.emplace_back(components[0], components[1], components[2]);
+			data.seed_norm.emplace_back(components[3], components[4], components[5]);
+		}
+		data.grid_span.resize(patch_num);
+		std::vector<float> seed_bias(size_t(patch_num) * 2);
+		patches->align(alignment);
+		patches->read_array(data.grid_span.data(), patch_num);
+		patches->align(alignment);
+		patches->read_array(seed_bias.data(), seed_bias.size());
+		for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+			data.seed_bias.emplace_back(seed_bias[patch_index * 2], seed_bias[patch_index * 2 + 1]);
+		}
+	}
+	else {
+		for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+			BinaryFormat::PatchRecord record;
+			patches->read(record);
+			data.seed_cord.emplace_back(record.seed[0], record.seed[1], record.seed[2]);
+			data.seed_norm.emplace_back(record.normal[0], record.normal[1], record.normal[2]);
+			data.grid_span.push_back(record.grid_span);
+			data.seed_bias.emplace_back(record.seed_bias[0], record.seed_bias[1]);
+		}
+	}
+
+	// 掩码
+	init_masks(data);
+	if (encodings[uint32_t(BinaryFormat::Section::Masks)] == uint32_t(BinaryFormat::Encoding::Bitset)) {
+		// 位图按字节保存，主机为小端序，逐个patch复制到uint64中，清除超出网格数的位
+		const uint8_t* mask_bits;
+		masks->view_array(mask_bits, mask_bytes * patch_num);
+		uint64_t tail = feature_len % 64 == 0 ? ~0ull : (1ull << (feature_len % 64)) - 1;
+		for (int patch_index = 0; patch_index < patch_num && masks->good(); ++patch_index) {
+			uint64_t* words = data.mask_bits.data() + size_t(patch_index) * data.mask_words;
+			std::memcpy(words, mask_bits + mask_bytes * patch_index, mask_bytes);
+			words[data.mask_words - 1] &= tail;
+		}
+	}
+	else {
+		std::vector<int> mask_offset(patch_num + 1);
+		masks->read_array(mask_offset.data(), mask_offset.size());
+		std::vector<uint16_t> mask_grid(masks->good() ? std::max(mask_offset[patch_num], 0) : 0);
+		masks->align(alignment);
+		masks->read_array(mask_grid.data(), mask_grid.size());
+		for (int patch_index = 0; patch_index < patch_num && masks->good(); ++patch_index) {
+			if (mask_offset[patch_index] < 0 || mask_offset[patch_index] > mask_offset[patch_index + 1]) {
+				std::cout << "ERROR: 二进制文件的掩码损坏" << std::endl;
+				return false;
+			}
+			for (int i = mask_offset[patch_index]; i < mask_offset[patch_index + 1]; ++i) {
+				if (!set_mask_bit(data, patch_index, mask_grid[i])) return false;
+			}
+		}
+	}
+
+	// 包围球，旧文件中没有
+	BinaryReader* bounds = section(BinaryFormat::Section::Bounds);
+	if (bounds) {
+		for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+			BinaryFormat::PatchBound bound;
+			if (!bounds->read(bound)) {
+				std::cout << "ERROR: 二进制文件的包围球损坏" << std::endl;
+				return false;
+			}
+			data.bounds.emplace_back(bound.center[0], bound.center[1], bound.center[2], bound.radius);
+		}
+	}
+
+	// 连接性，grid号加1保存；面的顺序与文本格式相同
+	uint32_t counts[4] = {};
+	connectivity->read_array(counts, 4);
+	auto view_block = [&](auto& values, size_t count) {
+		connectivity->align(alignment);
+		connectivity->view_array(values, count);
+	};
+	const int *patch_face_offset, *bi_crackface_offset, *bi_patch, *tri_patch;
+	const uint16_t *patch_face_grid, *bi_grid, *tri_grid;
+	view_block(patch_face_offset, patch_num + 1);
+	view_block(patch_face_grid, size_t(counts[0]) * 3);
+	view_block(bi_crackface_offset, patch_num + 1);
+	view_block(bi_grid, size_t(counts[1]) * 3);
+	view_block(bi_patch, counts[1]);
+	view_block(tri_patch, size_t(counts[2]) * 3);
+	view_block(tri_grid, size_t(counts[2]) * 3);
+	if (!features->good() || (codes && !codes->good()) || !patches->good() || !masks->good() || !connectivity->good()
+		|| patch_face_offset[patch_num] != int(counts[0]) || bi_crackface_offset[patch_num] != int(counts[1])) {
+		std::cout << "ERROR: 二进制文件数据不完整" << std::endl;
+		return false;
+	}
+	for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+		if (patch_face_offset[patch_index] < 0 || patch_face_offset[patch_index] > patch_face_offset[patch_index + 1]
+			|| bi_crackface_offset[patch_index] < 0 || bi_crackface_offset[patch_index] > bi_crackface_offset[patch_index + 1]) {
+			std::cout << "ERROR: 二进制文件的连接性损坏" << std::endl;
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < counts[2]; ++i) {
+		faces_on_grid.push_back({ tri_patch[i * 3], tri_grid[i * 3] - 1, tri_patch[i * 3 + 1], tri_grid[i * 3 + 1] - 1,
+			tri_patch[i * 3 + 2], tri_grid[i * 3 + 2] - 1 });
+	}
+	for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+		for (int i = patch_face_offset[patch_index]; i < patch_face_offset[patch_index + 1]; ++i) {
+			faces_on_grid.push_back({ patch_index, patch_face_grid[i * 3] - 1, patch_index, patch_face_grid[i * 3 + 1] - 1,
+				patch_index, patch_face_grid[i * 3 + 2] - 1 });
+		}
+		for (int i = bi_crackface_offset[patch_index]; i < bi_crackface_offset[patch_index + 1]; ++i) {
+			faces_on_grid.push_back({ patch_index, bi_grid[i * 3] - 1, patch_index, bi_grid[i * 3 + 1] - 1,
+				bi_patch[i], bi_grid[i * 3 + 2] - 1 });
+		}
+	}
+
+	// 渐进布局的层数和各层偏移，只解码还原需要的前几层
+	if (levels) {
+		uint32_t level_count = 0, reserved;
+		levels->read(level_count);
+		levels->read(reserved);
+		int max_atoms = 0;
+		for (const auto& dictionary : data.dictionaries) {
+			max_atoms = std::max(max_atoms, int(dictionary.cols()));
+		}
+		if (!levels->good() || level_count != uint32_t(max_atoms)) {
+			std::cout << "ERROR: 二进制文件的原子层数损坏" << std::endl;
+			return false;
+		}
+		data.levels.offset.resize(level_count + 1);
+		levels->read_array(data.levels.offset.data(), data.levels.offset.size());
+		for (uint32_t k = 0; k < level_count; ++k) {
+			if (!levels->good() || data.levels.offset[k] > data.levels.offset[k + 1] || data.levels.offset[level_count] > data.levels.size) {
+				std::cout << "ERROR: 二进制文件的原子层偏移损坏" << std::endl;
+				return false;
+			}
+		}
+		return read_levels(data, data.atom_limit);
+	}
+	return true;
+}
+
+bool Parser::read_levels(CompressedData& data, int count) {
+	auto& levels = data.levels;
+	count = std::min(count, int(levels.offset.size()) - 1);
+	// 文件被截断时只解码已经完整写入的层，还原时只用这些层的原子
+	int complete = count;
+	while (complete > levels.levels_read && levels.offset[complete] > levels.available) --complete;
+	if (complete < count) {
+		std::cout << "LOG: 文件只包含前" << complete << "层完整的原子层，暂时用" << complete << "个原子还原" << std::endl;
+		count = complete;
+	}
+	const size_t alignment = BinaryFormat::alignment;
+	std::vector<uint8_t> decoded;
+	std::vector<float> row;
+	for (int k = levels.levels_read; k < count; ++k) {
+		const char* level_data = levels.section + levels.offset[k];
+		size_t level_size = levels.offset[k + 1] - levels.offset[k];
+		if (levels.coded) {
+			if (!rans_decode(reinterpret_cast<const uint8_t*>(level_data), level_size, decoded, thread_pool)) {
+				std::cout << "ERROR: 二进制文件的熵编码数据损坏" << std::endl;
+				return false;
+			}
+			level_data = reinterpret_cast<const char*>(decoded.data());
+			level_size = decoded.size();
+		}
+		// 第k层依次为各特征字典的第k列和编码的第k行，原子数不足k + 1的特征跳过
+		BinaryReader level(level_data, level_size);
+		for (int i = 0; i < data.dictionaries.size() && level.good(); ++i) {
+			int rows = data.dictionaries[i].rows(), _atoms = data.codes[i].rows(), columns = data.codes[i].cols();
+			if (k >= _atoms) continue;
+			float* dictionary = levels.dictionaries[i] ? levels.dictionaries[i] + size_t(k) * rows : nullptr;
+			row.resize(columns);
+			if (levels.quantized) {
+				float offset, step;
+				const uint8_t* stream;
+				if (dictionary) {
+					level.read(offset);
+					level.read(step);
+					level.align(alignment);
+					size_t column_bytes = quantized_bytes(rows, 16);
+					if (level.view_array(stream, column_bytes)) {
+						dequantize(stream, column_bytes, rows, 16, offset, step, dictionary);
+					}
+				}
+				uint8_t bits = 0;
+				level.align(alignment);
+				level.read(offset);
+				level.read(step);
+				level.read(bits);
+				if (bits > 24) {
+					std::cout << "ERROR: 二进制文件的量化位数损坏" << std::endl;
+					return false;
+				}
+				level.align(alignment);
+				size_t row_bytes = quantized_bytes(columns, bits);
+				if (level.view_array(stream, row_bytes)) {
+					dequantize(stream, row_bytes, columns, bits, offset, step, row.data());
+				}
+			}
+			else {
+				if (dictionary) {
+					level.align(alignment);
+					level.read_array(dictionary, rows);
+				}
+				level.align(alignment);
+				level.read_array(row.data(), columns);
+			}
+			// 编码矩阵列优先，第k行的元素间隔为原子数
+			for (int j = 0; j < columns; ++j) {
+				levels.codes[i][size_t(j) * _atoms + k] = row[j];
+			}
+			level.align(alignment);
+		}
+		if (!level.good()) {
+			std::cout << "ERROR: 二进制文件的原子层损坏" << std::endl;
+			return false;
+		}
+		levels.levels_read = k + 1;
+	}
+	return true;
+}
+
+bool Parser::remap_levels(CompressedData& data) {
+	auto& levels = data.levels;
+	MappedFile file;
+	if (!file.open(data.path)) {
+		std::cout << "ERROR: 读取路径错误" << std::endl;
+		return false;
+	}
+	// 文件头、段表和层偏移表须与上次相同，确认是同一个文件继续写入，其余已读取的段不再比较
+	size_t prefix = levels.section_offset + 8 + levels.offset.size() * sizeof(uint64_t);
+	if (file.size() < data.file.size() || std::memcmp(file.data(), data.file.data(), prefix) != 0) {
+		std::cout << "ERROR: 压缩文件在两次读取之间被改写" << std::endl;
+		return false;
+	}
+	// 渐进布局的字典和编码已经解码到storage，只有Atoms段指向映射的文件
+	levels.section = file.data() + levels.section_offset;
+	levels.available = std::min<uint64_t>(levels.size, file.size() - levels.section_offset);
+	data.file = std::move(file);
+	return true;
+}
+
+void Parser::reconstruct(const CompressedData& data, const std::vector<char>& selected) {
+	int feature_len = N_bins * N_bins;
 	/************ 处理patch信息 ************/
-	std::vector<int>(patch_num, 1).swap(patch_size); // 记录patch所包含的顶点数，主要用于调试
+	std::vector<int>(patch_num, 0).swap(patch_size); // 记录patch所包含的顶点数，主要用于调试
 	std::vector<int>().swap(vertex_to_patch); // 记录顶点号到patch号的映射，主要用于调试
 	std::vector<std::vector<int>>(patch_num).swap(patch_faces); // patch所包含的面号，主要用于调试
 
-	// 还原顶点
-	atoms = patch_dictionaries[0].cols(); // 因为现在只用到了一个特征，所以直接用下标0来获取特征数据了。但是可以看到显然本方法支持读取多个特征，使用不同下标即可
-	Eigen::MatrixXf patch_grid_height = patch_dictionaries[0] * patch_codes[0];
-	assert(patch_grid_height.rows() == feature_len);
-	assert(patch_grid_height.cols() == patch_num);
-	
+	// 要还原的顶点：选中的patch还原种子点和掩码中的所有grid，其他patch只还原保留的缝隙面用到的grid
+	mask_words = data.mask_words;
+	std::vector<uint64_t>(data.mask_bits.size(), 0).swap(vertex_bits);
+	vertex_seed = selected;
+	for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
+		if (selected[patch_index]) {
+			size_t first = size_t(patch_index) * mask_words;
+			std::copy(data.mask_bits.begin() + first, data.mask_bits.begin() + first + mask_words, vertex_bits.begin() + first);
+		}
+	}
+	std::vector<char> keep_face(faces_on_grid.size(), 0);
+	for (int i = 0; i < faces_on_grid.size(); ++i) {
+		const auto& face = faces_on_grid[i];
+		for (int k = 0; k < 3; ++k) {
+			if (face[k * 2] < 0 || face[k * 2] >= patch_num || face[k * 2 + 1] < -1 || face[k * 2 + 1] >= feature_len) {
+				std::cout << "ERROR: 面的patch号或grid号超出范围" << std::endl;
+				return;
+			}
+		}
+		keep_face[i] = selected[face[0]] || selected[face[2]] || selected[face[4]];
+		if (!keep_face[i]) continue;
+		for (int k = 0; k < 3; ++k) {
+			int patch = face[k * 2], grid = face[k * 2 + 1];
+			if (selected[patch]) continue;
+			if (grid < 0) {
+				vertex_seed[patch] = 1;
+			}
+			else {
+				vertex_bits[size_t(patch) * mask_words + grid / 64] |= 1ull << (grid % 64);
+			}
+		}
+	}
 
+	// 顶点编号：每个patch的顶点连续排列，先种子点再按grid号升序
+	std::vector<int>(patch_num + 1, 0).swap(patch_first_vertex);
 	for (int patch_index = 0; patch_index < patch_num; ++patch_index) {
-		Eigen::Vector3f seed_cord = patch_cord[patch_index];
-		Eigen::Vector3f seed_norm = patch_norm[patch_index];
-		Eigen::Matrix4f transform = Compressor::generate_transform(seed_cord, seed_norm);
-		map_grid_to_vertex(patch_index, -1, seed_cord); // 先记录种子点，种子点不包含在grid里
+		const uint64_t* bits = vertex_bits.data() + size_t(patch_index) * mask_words;
+		patch_size[patch_index] = vertex_seed[patch_index] + popcount(bits, mask_words);
+		patch_first_vertex[patch_index + 1] = patch_first_vertex[patch_index] + patch_size[patch_index];
+		vertex_to_patch.insert(vertex_to_patch.end(), patch_size[patch_index], patch_index);
+	}
+	vertices->resize(patch_first_vertex[patch_num]);
 
-		float grid_span = patch_grid_span[patch_index];
-		float base_x = -grid_span * N_bins / 2.0f, base_y = base_x;
+	// 还原顶点
+	decode_vertices(data);
 
-		for (int grid : patch_mask[patch_index]) {
-			patch_size[patch_index] += 1;
-			int grid_y = grid / N_bins;
-			int grid_x = grid % N_bins;
-			float x = base_x + (grid_x + 0.5f) * grid_span + patch_seed_bias[patch_index][0];
-			float y = base_y + (grid_y + 0.5f) * grid_span + patch_seed_bias[patch_index][1];
-			float height = patch_grid_height(grid, patch_index);
-			Eigen::Vector4f point_cord = transform.inverse() * Eigen::Vector4f(x, y, height, 1.0f);
-			if (point_cord[3] != 0) {
-				point_cord /= point_cord[3];
+	// 还原面
+	auto get_color = [](int i, int total) -> Eigen::Vector3f {
+		if (total == 1) return Eigen::Vector3f(1.0f, 0.0f, 0.0f);
+		float value = (2.0f / (total - 1)) * i;
+		value = std::min(value, 2.0f);
+		float r = 0.0f, g = 0.0f, b = 0.0f;
+		if (value <= 1.0f) {
+			r = 1.0 - value;
+			g = value;
+		}
+		else {
+			g = 2.0f - value;
+			b = value - 1.0f;
+		}
+		return Eigen::Vector3f(r, g, b);
+	};
+	for (int face_index = 0; face_index < faces_on_grid.size(); ++face_index) {
+		if (!keep_face[face_index]) continue;
+		const auto& face = faces_on_grid[face_index];
+		int triangle[3], patch[3];
+		for (int k = 0; k < 3; ++k) {
+			patch[k] = face[k * 2];
+			triangle[k] = grid_vertex(face[k * 2], face[k * 2 + 1]);
+			if (triangle[k] < 0) {
+				std::cout << "ERROR: 面引用了掩码中没有的grid" << std::endl;
+				return;
 			}
-			map_grid_to_vertex(patch_index, grid, Eigen::Vector3f(point_cord[0], point_cord[1], point_cord[2]));
 		}
-	}
-	// 还原面
-	for (const auto& face : faces_on_grid) {
-		int patch0 = face[0][0], grid0 = face[0][1];
-		int patch1 = face[1][0], grid1 = face[1][1];
-		int patch2 = face[2][0], grid2 = face[2][1];
-		assert(grid_to_vertex.find({ patch0, grid0 }) != grid_to_vertex.end());
-		int v0 = grid_to_vertex[{ patch0, grid0 }];
-		assert(grid_to_vertex.find({ patch1, grid1 }) != grid_to_vertex.end());
-		int v1 = grid_to_vertex[{ patch1, grid1 }];
-		assert(grid_to_vertex.find({ patch2, grid2 }) != grid_to_vertex.end());
-		int v2 = grid_to_vertex[{ patch2, grid2 }];
-		faces->push_back({ v0, v1, v2 });
-		if (patch0 == patch1 && patch0 == patch2) { // patch内的三角形
-			patch_faces[patch0].push_back(faces->size() - 1);
+		faces->push_back({ triangle[0], triangle[1], triangle[2] });
+		if (patch[0] == patch[1] && patch[0] == patch[2]) { // patch内的三角形
+			patch_faces[patch[0]].push_back(faces->size() - 1);
 		}
 
 		// 顺便写坐标数组和颜色数组
-		auto get_color = [](int i, int total) -> Eigen::Vector3f {
-			if (total == 1) return Eigen::Vector3f(1.0f, 0.0f, 0.0f);
-			float value = (2.0f / (total - 1)) * i;
-			value = std::min(value, 2.0f);
-			float r = 0.0f, g = 0.0f, b = 0.0f;
-			if (value <= 1.0f) {
-				r = 1.0 - value;
-				g = value;
-			}
-			else {
-				g = 2.0f - value;
-				b = value - 1.0f;
-			}
-			return Eigen::Vector3f(r, g, b);
-		};
-		std::vector<int> triangle = { v0, v1, v2 };
-		std::vector<int> patch = { patch0, patch1, patch2 };
 		for (int i = 0; i < 3; ++i) {
 			int point_index = triangle[i];
 			vertex_data->push_back(vertices->at(point_index)[0]);
@@ -213,11 +896,105 @@ void Parser::parse(std::string load_path) {
 			color_data->push_back(color[2]);
 		}
 	}
+	refinable = true;
+}
+
+void Parser::decode_vertices(const CompressedData& data) {
+	int feature_len = N_bins * N_bins;
+	int total_features = data.dictionaries.size();
+	auto need_height = [&](int patch_index) {
+		const uint64_t* bits = vertex_bits.data() + size_t(patch_index) * mask_words;
+		return std::any_of(bits, bits + mask_words, [](uint64_t word) { return word != 0; });
+	};
+
+	// 每个聚类用各自的字典解码需要还原顶点的patch，结果留在各聚类的高度矩阵中，patch_height指向每个patch的高度列
+	// 只用前atom_limit个原子，渐进布局时还不能超过已解码的层数，没用到的原子相当于系数为0
+	int limit = data.atom_limit;
+	if (!data.levels.offset.empty()) limit = std::min(limit, data.levels.levels_read);
+	atoms = 0;
+	std::vector<Eigen::MatrixXf> cluster_heights(total_features);
+	std::vector<const float*> patch_height(patch_num, nullptr);
+	for (int i = 0; i < total_features; ++i) {
+		int used = std::min(limit, int(data.dictionaries[i].cols()));
+		atoms = std::max(atoms, used);
+		std::vector<int> columns;
+		for (int j = 0; j < data.cluster_patches[i].size(); ++j) {
+			if (need_height(data.cluster_patches[i][j])) columns.push_back(j);
+		}
+		if (columns.empty()) continue;
+		Eigen::MatrixXf& cluster_height = cluster_heights[i];
+		if (data.feature_sparse[i]) {
+			// 稀疏编码的patch只需要组合用到的几个原子
+			cluster_height.setZero(feature_len, columns.size());
+			for (int j = 0; j < columns.size(); ++j) {
+				for (const auto& [index, value] : data.sparse_codes[data.cluster_patches[i][columns[j]]]) {
+					if (index >= used) continue;
+					cluster_height.col(j) += value * data.dictionaries[i].col(index);
+				}
+			}
+		}
+		else if (columns.size() == data.cluster_patches[i].size()) {
+			// 全部需要时直接与映射的编码相乘，否则只取出需要的列
+			cluster_height.noalias() = data.dictionaries[i].leftCols(used) * data.codes[i].topRows(used);
+		}
+		else {
+			Eigen::MatrixXf code(used, columns.size());
+			for (int j = 0; j < columns.size(); ++j) {
+				code.col(j) = data.codes[i].col(columns[j]).head(used);
+			}
+			cluster_height.noalias() = data.dictionaries[i].leftCols(used) * code;
+		}
+		assert(cluster_height.rows() == feature_len);
+		for (int j = 0; j < columns.size(); ++j) {
+			patch_height[data.cluster_patches[i][columns[j]]] = cluster_height.col(j).data();
+		}
+	}
+
+	// 各patch的顶点互不重叠，按patch并行计算，每个线程用自己的临时数组
+	struct PatchPoints {
+		std::vector<float> x, y, z; // 一个patch内所有grid顶点的坐标，SoA格式，先存局部坐标，原地变换为世界坐标
+		std::vector<int> mask; // 一个patch内有顶点的grid号
+	};
+	std::vector<PatchPoints> thread_points(thread_pool.size());
+	dispatch_grid_kernel(N_bins, [&](auto kernel) {
+		thread_pool.parallel_for(0, patch_num, [&](int patch_index, int thread_index) {
+			// 遍历位图的置位得到升序的grid号，顶点顺序与grid号顺序一致
+			const uint64_t* bits = vertex_bits.data() + size_t(patch_index) * mask_words;
+			int n = popcount(bits, mask_words);
+			int vertex_index = patch_first_vertex[patch_index];
+			if (vertex_seed[patch_index]) {
+				(*vertices)[vertex_index++] = data.seed_cord[patch_index]; // 先记录种子点，种子点不包含在grid里
+			}
+			if (n == 0) return;
+			LocalFrame frame = LocalFrame::from_transform(Compressor::generate_transform(data.seed_cord[patch_index], data.seed_norm[patch_index])).inverse();
+			PatchPoints& points = thread_points[thread_index];
+			points.mask.resize(n);
+			points.x.resize(n);
+			points.y.resize(n);
+			points.z.resize(n);
+			int count = 0;
+			for_each_set_bit(bits, mask_words, [&](int grid) { points.mask[count++] = grid; });
+			kernel.grid_center(points.mask.data(), n, data.grid_span[patch_index], data.seed_bias[patch_index][0], data.seed_bias[patch_index][1],
+				points.x.data(), points.y.data());
+			for (int i = 0; i < n; ++i) {
+				points.z[i] = patch_height[patch_index][points.mask[i]];
+			}
+			transform_points(frame, points.x.data(), points.y.data(), points.z.data(), n, points.x.data(), points.y.data(), points.z.data());
+			for (int i = 0; i < n; ++i) {
+				(*vertices)[vertex_index + i] = Eigen::Vector3f(points.x[i], points.y[i], points.z[i]);
+			}
+		}, 16);
+	});
+}
+
+void Parser::add_shared_dictionary(const Eigen::MatrixXf& dictionary, uint64_t hash) {
+	shared_dictionaries[hash] = dictionary;
 }
 
 void Parser::init(std::vector<Eigen::Vector3f>* _vertices, std::vector<std::vector<int>>* _faces, std::vector<float>* _vertex_data, std::vector<float>* _color_data) {
 	vertices = _vertices;
 	faces = _faces;
+	thread_pool.init(0);
 	vertex_data = _vertex_data;
 	color_data = _color_data;
 }
@@ -1,6 +1,14 @@
 ﻿#pragma once
 
 #include <core/core.h>
+#include <tools/bit_ops.h>
+#include <tools/mapped_file.h>
+#include <tools/thread_pool.h>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
 
 class Parser {
 public:
@@ -14,8 +22,23 @@ public:
 
 	// 初始化
 	void init(std::vector<Eigen::Vector3f>* _vertices, std::vector<std::vector<int>>* _faces, std::vector<float>* _vertex_data, std::vector<float>* _color_data);
-	// 读取压缩文件并还原mesh
+	// 登记共享字典，压缩文件通过哈希引用
+	void add_shared_dictionary(const Eigen::MatrixXf& dictionary, uint64_t hash);
+	// 读取压缩文件并还原mesh，根据文件开头的magic自动识别二进制格式和文本格式
 	void parse(std::string load_path);
+	// 每个特征只用前max_atoms个原子(奇异值最大的几个)还原粗糙的mesh，max_atoms <= 0时使用全部原子
+	// 渐进布局的二进制文件只解码前max_atoms层
+	void parse(std::string load_path, int max_atoms);
+	// 在上一次解码的基础上改用前max_atoms个原子，原地更新顶点坐标和坐标数组，面不变；渐进布局时继续解码后面的层
+	bool refine(int max_atoms);
+	// 释放上一次读取时映射的文件和保留的数据，之后不能再refine；Windows下文件映射期间不能删除文件
+	void close();
+	// 只还原patches中的patch，以及与它们相连的缝隙面，缝隙面用到的其他patch只还原对应的顶点
+	void parse_patches(std::string load_path, const std::vector<int>& patches);
+	// 只还原包围球与box相交的patch，需要二进制格式中的包围球
+	void parse_region(std::string load_path, const Eigen::AlignedBox3f& box);
+	// 只还原包围球与视锥相交的patch，planes为视锥的各个平面(a, b, c, d)，ax + by + cz + d >= 0为内侧
+	void parse_frustum(std::string load_path, const std::vector<Eigen::Vector4f>& planes);
 	// 记录patch相关信息
 	void write_patch_info(const std::vector<std::vector<int>>*& _patch_faces, const std::vector<int>*& _vertex_to_patch, 
 		const std::vector<int>*& _patch_size, int& _feature_len, int& _atoms);
@@ -24,12 +47,90 @@ private:
 	int N_bins;
 	int patch_num;
 	int atoms;
-	std::vector<std::vector<std::vector<int>>> faces_on_grid;
-	std::map<std::vector<int>, int> grid_to_vertex;
+	std::vector<std::array<int, 6>> faces_on_grid; // 面的三个顶点(patch0, grid0, patch1, grid1, patch2, grid2)，种子点的grid号为-1
+	// 已还原的顶点：每个patch的顶点连续排列，先种子点再按grid号升序，(patch, grid)的顶点号由位图中低位的置位数得到
+	int mask_words;
+	std::vector<int> patch_first_vertex; // 每个patch第一个顶点的顶点号，最后多一个为顶点总数
+	std::vector<char> vertex_seed; // 每个patch是否还原了种子点
+	std::vector<uint64_t> vertex_bits; // 每个patch还原了的grid，布局与CompressedData::mask_bits相同
 	std::vector<std::vector<int>> patch_faces; // 记录patch所包含的面号，主要用于调试
 	std::vector<int> vertex_to_patch; // 记录顶点号到patch号的映射，主要用于调试
 	std::vector<int> patch_size; // 记录patch所包含的顶点数，主要用于调试
+	std::map<uint64_t, Eigen::MatrixXf> shared_dictionaries; // 哈希到共享字典的映射
+	ThreadPool thread_pool; // 用于并行解码熵编码的段和还原顶点
+	bool refinable = false; // 上一次解码是否成功，可以继续refine
 
-	// 把patch号/grid号映射到顶点号，用于还原面数据
-	void map_grid_to_vertex(int patch, int grid, const Eigen::Vector3f& cord);
+	using MatrixView = Eigen::Map<const Eigen::MatrixXf>;
+
+	// 从压缩文件读出的数据，两种格式读取后的内容相同
+	// 字典和编码是视图：二进制格式中原样保存的矩阵直接指向映射的文件，共享字典指向shared_dictionaries，其余的解码到storage
+	struct CompressedData {
+		MappedFile file; // 映射的二进制文件
+		std::string path; // 文件路径，refine时重新映射增长了的文件
+		std::vector<std::vector<uint8_t>> decoded_sections; // 熵编码的段解码后的数据
+		std::deque<Eigen::MatrixXf> storage; // 文本格式或量化等需要解码的矩阵，deque追加时已有元素的地址不变
+		std::vector<MatrixView> dictionaries; // 每个特征的字典
+		std::vector<MatrixView> codes; // 每个特征的稠密编码，稀疏编码时为空矩阵
+		std::vector<char> feature_sparse; // 该特征是否使用稀疏编码
+		std::vector<std::vector<int>> cluster_patches; // 每个特征对应的patch，按patch号升序对应编码矩阵的各列
+		std::vector<std::vector<std::pair<int, float>>> sparse_codes; // 稀疏编码的patch使用的原子和系数
+		std::vector<Eigen::Vector3f> seed_cord; // 种子点坐标
+		std::vector<Eigen::Vector3f> seed_norm; // 种子点法线
+		std::vector<float> grid_span; // patch网格的尺寸
+		std::vector<Eigen::Vector2f> seed_bias; // 采样网格的位移
+		int mask_words; // 每个patch的掩码位图占用的uint64个数
+		std::vector<uint64_t> mask_bits; // 掩码位图，patch i占[i * mask_words, (i + 1) * mask_words)，第g位表示grid g有顶点
+		std::vector<Eigen::Vector4f> bounds; // 每个patch的包围球(球心, 半径)，文件中没有时为空
+		int atom_limit = std::numeric_limits<int>::max(); // 还原时每个特征最多使用的原子数
+
+		// 渐进布局中按原子分层保存的字典和编码，先分配全0的矩阵，每解码一层填入字典的一列和编码的一行
+		struct AtomLevels {
+			const char* section = nullptr; // Atoms段的数据
+			uint64_t section_offset = 0; // Atoms段相对文件起点的偏移，重新映射文件后据此更新section
+			uint64_t size = 0; // 段表中Atoms段的大小
+			uint64_t available = 0; // 文件中已有的Atoms段字节数，渐进传输的文件被截断时小于size
+			std::vector<uint64_t> offset; // 各层相对段起点的偏移，为空表示不是渐进布局
+			bool coded = false; // 每层单独经过rANS编码
+			bool quantized = false;
+			int levels_read = 0; // 已解码的层数
+			std::vector<float*> dictionaries; // 每个特征解码的目标，共享字典时为空指针
+			std::vector<float*> codes;
+		} levels;
+
+		// 把解码得到的矩阵移入storage，返回指向它的视图
+		MatrixView keep(Eigen::MatrixXf&& matrix) {
+			storage.push_back(std::move(matrix));
+			return MatrixView(storage.back().data(), storage.back().rows(), storage.back().cols());
+		}
+	};
+	CompressedData loaded; // 上一次读取的数据，refine时继续使用
+
+	// 按N_bins和patch_num分配全0的掩码位图
+	void init_masks(CompressedData& data);
+	// 置位patch的掩码中的grid，grid超出范围时返回false
+	bool set_mask_bit(CompressedData& data, int patch, int grid);
+	// patch号/grid号对应的顶点号，没有还原时返回-1
+	int grid_vertex(int patch, int grid) const {
+		if (grid < 0) return vertex_seed[patch] ? patch_first_vertex[patch] : -1;
+		const uint64_t* bits = vertex_bits.data() + size_t(patch) * mask_words;
+		uint64_t bit = 1ull << (grid % 64);
+		if (!(bits[grid / 64] & bit)) return -1;
+		return patch_first_vertex[patch] + vertex_seed[patch] + popcount(bits, grid / 64) + popcount(bits[grid / 64] & (bit - 1));
+	}
+	// 读取文本格式，面写入faces_on_grid，失败时返回false
+	bool read_text(const std::string& load_path, CompressedData& data);
+	// 读取data.file中映射的二进制格式
+	bool read_binary(CompressedData& data);
+	// 解码渐进布局的第levels_read层到第count - 1层，文件被截断时只解码完整的层
+	bool read_levels(CompressedData& data, int count);
+	// 重新映射被截断的渐进布局文件，读取之后写入的层；文件头、段表或层偏移与上次不同时返回false
+	bool remap_levels(CompressedData& data);
+	// 共享字典的前atoms列在列优先的存储中是连续的，返回其起始地址，找不到时返回空指针
+	const float* find_shared_dictionary(uint64_t hash, int rows, int atoms);
+	// 读取压缩文件，select根据读出的数据标记要还原的patch，再还原选中的部分
+	void parse_selected(const std::string& load_path, int max_atoms, const std::function<bool(const CompressedData&, std::vector<char>&)>& select);
+	// 还原selected中的patch、至少有一个顶点属于这些patch的面，以及这些面用到的其他patch的顶点
+	void reconstruct(const CompressedData& data, const std::vector<char>& selected);
+	// 用前atom_limit个原子解码高度，计算所有已编号顶点的坐标
+	void decode_vertices(const CompressedData& data);
 };
\ No newline at end of file
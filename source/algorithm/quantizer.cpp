@@ -0,0 +1,112 @@
+﻿#include "quantizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define QUANTIZER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QUANTIZER_SSE2
+#endif
+
+int choose_quantization(float min, float max, float max_step, float& out_offset, float& out_step) {
+	float range = max - min;
+	int bits = 0;
+	if (range > max_step) {
+		bits = std::min(24, int(std::ceil(std::log2(double(range) / max_step + 1.0))));
+	}
+	fixed_quantization(min, max, bits, out_offset, out_step);
+	return bits;
+}
+
+void fixed_quantization(float min, float max, int bits, float& out_offset, float& out_step) {
+	if (bits == 0 || max <= min) {
+		out_offset = bits == 0 ? 0.5f * (min + max) : min;
+		out_step = 0.0f;
+		return;
+	}
+	out_offset = min;
+	out_step = (max - min) / float((1u << bits) - 1);
+}
+
+void quantize_append(const float* values, int n, int stride, int bits, float offset, float step, std::vector<uint8_t>& stream) {
+	if (bits == 0) return;
+	size_t start = stream.size();
+	stream.resize(start + quantized_bytes(n, bits), 0);
+	uint32_t max_q = (1u << bits) - 1;
+	uint64_t position = 0;
+	for (int i = 0; i < n; ++i) {
+		uint32_t q = 0;
+		if (step > 0.0f) {
+			float scaled = std::round((values[size_t(i) * stride] - offset) / step);
+			q = uint32_t(std::clamp(scaled, 0.0f, float(max_q)));
+		}
+		// 逐字节写入，一个整数最多跨4个字节
+		for (int written = 0; written < bits; ) {
+			size_t byte = start + (position >> 3);
+			int shift = position & 7;
+			int count = std::min(8 - shift, bits - written);
+			stream[byte] |= uint8_t(((q >> written) & ((1u << count) - 1)) << shift);
+			written += count;
+			position += count;
+		}
+	}
+}
+
+// 读出从第position位开始的bits位整数，只读取覆盖这些位的字节
+static inline uint32_t read_bits(const uint8_t* stream, uint64_t position, int bits) {
+	size_t byte = position >> 3;
+	size_t last = (position + bits + 7) >> 3;
+	uint32_t word = 0;
+	for (size_t k = byte; k < last; ++k) {
+		word |= uint32_t(stream[k]) << (8 * (k - byte)); // shift + bits <= 7 + 24，最多4个字节
+	}
+	return (word >> (position & 7)) & ((1u << bits) - 1);
+}
+
+void dequantize_scalar(const uint8_t* stream, int n, int bits, float offset, float step, float* out) {
+	if (bits == 0) {
+		std::fill(out, out + n, offset);
+		return;
+	}
+	for (int i = 0; i < n; ++i) {
+		out[i] = offset + step * float(read_bits(stream, uint64_t(i) * bits, bits));
+	}
+}
+
+void dequantize(const uint8_t* stream, size_t stream_bytes, int n, int bits, float offset, float step, float* out) {
+	if (bits == 0) {
+		std::fill(out, out + n, offset);
+		return;
+	}
+	int i = 0;
+	// 向量化部分不使用FMA，运算顺序与标量实现相同，两者结果逐位一致
+#if defined(QUANTIZER_AVX2)
+	// 每个整数从所在字节起gather 4个字节，因此只处理读取范围不超过stream_bytes的部分
+	__m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i bit_width = _mm256_set1_epi32(bits);
+	__m256i mask = _mm256_set1_epi32(int((1u << bits) - 1));
+	__m256i low_bits = _mm256_set1_epi32(7);
+	__m256 o = _mm256_set1_ps(offset), s = _mm256_set1_ps(step);
+	for (; i + 8 <= n && ((uint64_t(i + 7) * bits) >> 3) + 4 <= stream_bytes; i += 8) {
+		__m256i position = _mm256_add_epi32(_mm256_set1_epi32(i * bits), _mm256_mullo_epi32(lane, bit_width));
+		__m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(stream), _mm256_srli_epi32(position, 3), 1);
+		__m256i q = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(position, low_bits)), mask);
+		_mm256_storeu_ps(out + i, _mm256_add_ps(o, _mm256_mul_ps(s, _mm256_cvtepi32_ps(q))));
+	}
+#elif defined(QUANTIZER_SSE2)
+	// SSE2没有按元素移位和gather，整数在标量中解出，转换和乘加向量化
+	__m128 o = _mm_set1_ps(offset), s = _mm_set1_ps(step);
+	for (; i + 4 <= n; i += 4) {
+		__m128i q = _mm_setr_epi32(int(read_bits(stream, uint64_t(i) * bits, bits)), int(read_bits(stream, uint64_t(i + 1) * bits, bits)),
+			int(read_bits(stream, uint64_t(i + 2) * bits, bits)), int(read_bits(stream, uint64_t(i + 3) * bits, bits)));
+		_mm_storeu_ps(out + i, _mm_add_ps(o, _mm_mul_ps(s, _mm_cvtepi32_ps(q))));
+	}
+#endif
+	// 剩余部分
+	for (; i < n; ++i) {
+		out[i] = offset + step * float(read_bits(stream, uint64_t(i) * bits, bits));
+	}
+}
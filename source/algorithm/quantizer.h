@@ -0,0 +1,25 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 定点量化：value ≈ offset + step * q，q为bits位无符号整数
+// 位流中第i个整数占据第[i * bits, (i + 1) * bits)位，按小端序从字节的低位开始排列
+
+// 按最大允许步长选择位数，range = max - min不超过max_step时为0位，只保存中点；位数不超过24
+// offset和step写入out_offset和out_step
+int choose_quantization(float min, float max, float max_step, float& out_offset, float& out_step);
+// 按给定位数把[min, max]均匀量化，bits为0时offset取中点
+void fixed_quantization(float min, float max, int bits, float& out_offset, float& out_step);
+// 把n个值(间隔stride个float)量化为bits位整数，从新的字节开始追加到stream末尾
+void quantize_append(const float* values, int n, int stride, int bits, float offset, float step, std::vector<uint8_t>& stream);
+// 一行量化数据在位流中占用的字节数
+inline size_t quantized_bytes(int n, int bits) {
+	return (size_t(n) * bits + 7) / 8;
+}
+// 从位流中解出n个bits位整数并反量化：out[i] = offset + step * q[i]，stream_bytes为这一行可读的字节数
+// 根据编译选项使用AVX2或SSE2，否则退化为标量实现
+void dequantize(const uint8_t* stream, size_t stream_bytes, int n, int bits, float offset, float step, float* out);
+// 标量实现，用于对照和基准测试
+void dequantize_scalar(const uint8_t* stream, int n, int bits, float offset, float step, float* out);
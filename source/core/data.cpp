@@ -8,8 +8,31 @@ Config::Config(std::string json_file) {
 	nlohmann::json config = nlohmann::json::parse(f);
 
 	atoms = config["atoms"];
+	target_rms_error = config["target_rms_error"];
+	target_energy = config["target_energy"];
+	svd_backend = config["svd_backend"];
+	svd_oversampling = config["svd_oversampling"];
+	svd_power_iterations = config["svd_power_iterations"];
+	masked_iterations = config["masked_iterations"];
+	sparsity = config["sparsity"];
+	sparse_atoms = config["sparse_atoms"];
+	sparse_iterations = config["sparse_iterations"];
+	clusters = config["clusters"];
+	cluster_iterations = config["cluster_iterations"];
+	dictionary_path = config["dictionary_path"];
+	train_corpus = config["train_corpus"];
+	coding_chunk = config["coding_chunk"];
 	N_bins = config["N_bins"];
 	patch_size_limit = config["patch_size_limit"];
 	patch_normal_tolerance = config["patch_normal_tolerance"];
+	patch_growth = config["patch_growth"];
+	patch_order = config["patch_order"];
 	float_precision = config["float_precision"];
+	file_format = config["file_format"];
+	quantization_error = config["quantization_error"];
+	entropy_coding = config["entropy_coding"];
+	progressive = config["progressive"];
+	threads = config["threads"];
+	deterministic = config["deterministic"];
+	verbose = config["verbose"];
 }
@@ -20,9 +20,32 @@ struct Data {
 struct Config {
 	Config(std::string json_file);
 
-	int atoms;
+	int atoms; // 算子数，设置了误差目标时为算子数上限，-1表示不限制(满秩)
+	float target_rms_error; // 重建高度的均方根误差目标，0表示不使用
+	float target_energy; // 保留的奇异值能量(平方和)占比目标，0表示不使用
+	std::string svd_backend; // 编码使用的分解方法，"jacobi"、"bdc"、"gram"或"randomized"
+	int svd_oversampling; // 随机SVD在atoms之外多采样的列数
+	int svd_power_iterations; // 随机SVD的幂迭代次数
+	int masked_iterations; // 按掩码加权的ALS迭代次数，只拟合有顶点的网格，0表示不使用
+	int sparsity; // 稀疏编码时每个patch最多使用的原子数，0表示使用SVD的稠密编码
+	int sparse_atoms; // 稀疏编码的过完备字典大小
+	int sparse_iterations; // 稀疏编码字典更新(MOD)的迭代次数
+	int clusters; // 特征聚类数，每类使用单独的字典，1表示所有patch共用一个字典
+	int cluster_iterations; // k-means的最大迭代次数
+	std::string dictionary_path; // 共享字典文件，为空时不使用共享字典
+	std::string train_corpus; // 训练共享字典的网格目录，不为空时先训练并保存到dictionary_path
+	int coding_chunk; // 流式编码时每块的patch数，0表示一次性对整个特征矩阵编码；流式编码仍保存atoms × patch数的编码矩阵，atoms <= 0时取N_bins² / 4
 	int N_bins;
 	int patch_size_limit;
 	float patch_normal_tolerance;
+	std::string patch_growth; // patch生长方式，"bfs"按跳数扩展，"geodesic"按测地距离扩展
+	std::string patch_order; // patch编号顺序，"curvature"为seed的曲率顺序，"morton"按seed坐标的Morton码重新编号(空间局部性更好，但熵编码后的文件略大)，其他值按curvature处理
 	int float_precision;
+	std::string file_format; // 压缩文件格式，"text"为文本格式，"binary"为二进制格式
+	float quantization_error; // 二进制格式中编码量化引入的高度均方根误差目标，0表示不量化，按float保存
+	bool entropy_coding; // 二进制格式中各段是否再经过rANS熵编码
+	bool progressive; // 二进制格式是否按原子分层保存字典和编码，可以只解码前几个原子
+	int threads; // 压缩使用的线程数，0表示使用全部硬件线程
+	bool deterministic; // 确定性模式，压缩结果与线程数和调度无关；单线程时的patch划分也与串行生长不同，默认关闭
+	bool verbose; // 输出额外的诊断信息
 };
\ No newline at end of file
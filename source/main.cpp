@@ -11,6 +11,7 @@
 #include <tools/load_obj_mesh.h>
 #include <display/polygon_picker.h>
 #include <algorithm/compressor.h>
+#include <algorithm/dictionary.h>
 #include <algorithm/parser.h>
 #include <display/opengl_window.h>
 
@@ -37,6 +38,17 @@ int main() {
 	shared_ptr<Data> recovered_data = make_shared<Data>();
 	Config config("config.json");
 
+	// 共享字典：训练后保存，或直接读取已有的字典文件
+	SharedDictionary shared_dictionary;
+	if (!config.train_corpus.empty()) {
+		if (shared_dictionary.train(config.train_corpus, config)) {
+			shared_dictionary.save(config.dictionary_path);
+		}
+	}
+	else if (!config.dictionary_path.empty()) {
+		shared_dictionary.load(config.dictionary_path);
+	}
+
 	// 加载
 	ObjLoader obj_loader;
 	std::string original_mesh_path = "resource/mesh/FinalBaseMesh.obj";
@@ -51,7 +63,10 @@ int main() {
 	// 压缩
 	Compressor compressor;
 	std::string recovered_mesh_path = "mesh_compressed.data";
-	compressor.init(&original_data->vertices, &original_data->faces, &original_data->normals, config.N_bins, config.patch_size_limit, config.patch_normal_tolerance, config.float_precision);
+	compressor.init(&original_data->vertices, &original_data->faces, &original_data->normals, config);
+	if (shared_dictionary.hash != 0) {
+		compressor.set_shared_dictionary(shared_dictionary.dictionary, shared_dictionary.hash);
+	}
 	compressor.generate_patch_color(&original_data->color_data);
 	compressor.compress_and_save(config.atoms, recovered_mesh_path);
 	compressor.write_patch_info(original_data->patch_faces, original_data->vertex_to_patch, original_data->patch_size, original_data->feature_len, original_data->atoms);
@@ -60,6 +75,9 @@ int main() {
 	// 解压缩
 	Parser parser;
 	parser.init(&recovered_data->vertices, &recovered_data->faces, &recovered_data->vertex_data, &recovered_data->color_data);
+	if (shared_dictionary.hash != 0) {
+		parser.add_shared_dictionary(shared_dictionary.dictionary, shared_dictionary.hash);
+	}
 	parser.parse(recovered_mesh_path);
 	parser.write_patch_info(recovered_data->patch_faces, recovered_data->vertex_to_patch, recovered_data->patch_size, recovered_data->feature_len, recovered_data->atoms);
 
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// zigzag变换把有符号的差值映射为无符号数，使绝对值小的差值高位字节为0：0, -1, 1, -2...映射为0, 1, 2, 3...
+inline uint32_t zigzag_encode(int32_t value) {
+	return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+inline int32_t zigzag_decode(uint32_t value) {
+	return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+// 二进制文件按主机字节序直接读写数值，文件格式规定为小端序，大端序主机上读写前须先检查
+inline bool is_little_endian() {
+	const uint16_t value = 1;
+	unsigned char byte;
+	std::memcpy(&byte, &value, 1);
+	return byte == 1;
+}
+
+// 在内存中拼接二进制数据，写完后整体保存
+class BinaryWriter {
+public:
+	// 追加一个值，返回其在缓冲区中的偏移
+	template <typename T>
+	size_t write(const T& value) {
+		return write_array(&value, 1);
+	}
+	// 追加count个连续的值，返回起始偏移
+	template <typename T>
+	size_t write_array(const T* data, size_t count) {
+		static_assert(std::is_trivially_copyable<T>::value, "只能写入平凡可复制的类型");
+		size_t offset = bytes.size();
+		bytes.resize(offset + sizeof(T) * count);
+		if (count > 0) std::memcpy(bytes.data() + offset, data, sizeof(T) * count);
+		return offset;
+	}
+	// 补0直到长度为alignment的整数倍
+	void align(size_t alignment) {
+		bytes.resize((bytes.size() + alignment - 1) / alignment * alignment, 0);
+	}
+	// 改写已写入的值，用于回填文件头和段表
+	template <typename T>
+	void overwrite(size_t offset, const T& value) {
+		std::memcpy(bytes.data() + offset, &value, sizeof(T));
+	}
+	size_t size() const { return bytes.size(); }
+	const std::vector<char>& buffer() const { return bytes; }
+	bool save(const std::string& path) const {
+		std::ofstream outfile(path, std::ios::binary);
+		if (!outfile.is_open()) return false;
+		outfile.write(bytes.data(), bytes.size());
+		return bool(outfile);
+	}
+
+private:
+	std::vector<char> bytes;
+};
+
+// 顺序读取一段内存中的二进制数据，越界时后续读取全部失败
+class BinaryReader {
+public:
+	BinaryReader(const char* _data, size_t _size) : data(_data), length(_size) {}
+
+	template <typename T>
+	bool read(T& value) {
+		return read_array(&value, 1);
+	}
+	template <typename T>
+	bool read_array(T* out, size_t count) {
+		static_assert(std::is_trivially_copyable<T>::value, "只能读取平凡可复制的类型");
+		if (!check(sizeof(T) * count)) return false;
+		if (count > 0) std::memcpy(out, data + position, sizeof(T) * count);
+		position += sizeof(T) * count;
+		return true;
+	}
+	// 不复制数据，out指向当前位置并前进count个元素，越界时out为空指针
+	// 调用方保证当前位置按T对齐，out在底层内存释放前有效
+	template <typename T>
+	bool view_array(const T*& out, size_t count) {
+		static_assert(std::is_trivially_copyable<T>::value, "只能读取平凡可复制的类型");
+		out = nullptr;
+		if (!check(sizeof(T) * count)) return false;
+		out = reinterpret_cast<const T*>(data + position);
+		position += sizeof(T) * count;
+		return true;
+	}
+	// 跳到下一个alignment的整数倍位置，偏移相对于这段内存的起点
+	bool align(size_t alignment) {
+		size_t next = (position + alignment - 1) / alignment * alignment;
+		if (!check(next - position)) return false;
+		position = next;
+		return true;
+	}
+	// 从当前位置截取size字节作为子读取器
+	BinaryReader sub(size_t size) {
+		if (!check(size)) return BinaryReader(nullptr, 0);
+		BinaryReader reader(data + position, size);
+		position += size;
+		return reader;
+	}
+	bool seek(size_t offset) {
+		if (offset > length) {
+			failed = true;
+			return false;
+		}
+		position = offset;
+		return true;
+	}
+	size_t tell() const { return position; }
+	size_t size() const { return length; }
+	bool good() const { return !failed; }
+
+private:
+	const char* data;
+	size_t length;
+	size_t position = 0;
+	bool failed = false;
+
+	bool check(size_t size) {
+		if (failed || size > length - position) {
+			failed = true;
+			return false;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 64位字的位操作，MSVC与GCC/Clang的内建函数不同
+
+// 最低置位的位号，x不能为0
+inline int count_trailing_zeros(uint64_t x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return int(index);
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+// 置位的个数
+inline int popcount(uint64_t x) {
+#ifdef _MSC_VER
+	return int(__popcnt64(x));
+#else
+	return __builtin_popcountll(x);
+#endif
+}
+
+// 位图中置位的总数
+inline int popcount(const uint64_t* words, int word_count) {
+	int count = 0;
+	for (int k = 0; k < word_count; ++k) {
+		count += popcount(words[k]);
+	}
+	return count;
+}
+
+// 按位号从小到大对每个置位调用func(位号)，每次取出最低置位后清除，只访问置位
+template<typename Func>
+inline void for_each_set_bit(const uint64_t* words, int word_count, Func&& func) {
+	for (int k = 0; k < word_count; ++k) {
+		for (uint64_t word = words[k]; word != 0; word &= word - 1) {
+			func(k * 64 + count_trailing_zeros(word));
+		}
+	}
+}
+
+// 把x的低21位分散到结果的第0, 3, 6...位
+inline uint64_t spread_bits_3d(uint32_t x) {
+	uint64_t v = x & 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+// 三维Morton码(Z序曲线)：交错x、y、z各21位，Morton码相近的点在空间上通常也相近
+inline uint64_t morton_code(uint32_t x, uint32_t y, uint32_t z) {
+	return spread_bits_3d(x) | spread_bits_3d(y) << 1 | spread_bits_3d(z) << 2;
+}
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// FNV-1a 64位哈希，用于比较压缩结果是否逐字节一致
+inline uint64_t fnv1a_hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// 计算整个文件的哈希，文件无法打开时返回0
+inline uint64_t fnv1a_hash_file(const std::string& path) {
+	std::ifstream infile(path, std::ios::binary);
+	if (!infile.is_open()) return 0;
+	uint64_t hash = 14695981039346656037ull;
+	char buffer[1 << 16];
+	while (infile) {
+		infile.read(buffer, sizeof(buffer));
+		hash = fnv1a_hash(buffer, size_t(infile.gcount()), hash);
+	}
+	return hash;
+}
@@ -61,6 +61,7 @@ bool ObjLoader::load_obj_mesh(const std::string& obj_file_path) {
 
 			// Loop over vertices in the face.
 			std::vector<int> tmp;
+			bool has_normal = true;
 			for (size_t v = 0; v < fv; v++) {
 				// access to vertex
 				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
@@ -75,6 +76,7 @@ bool ObjLoader::load_obj_mesh(const std::string& obj_file_path) {
 				tmp.push_back(int(idx.vertex_index));
 
 				// Check if `normal_index` is zero or positive. negative = no normal data
+				has_normal = has_normal && idx.normal_index >= 0;
 				if (idx.normal_index >= 0) {
 					tinyobj::real_t nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
 					tinyobj::real_t ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
@@ -82,6 +84,13 @@ bool ObjLoader::load_obj_mesh(const std::string& obj_file_path) {
 					normals->at(idx.vertex_index) += Eigen::Vector3f(nx, ny, nz);
 				}
 			}
+			// 没有法线数据的面用面法线(按面积加权)累加到顶点上
+			if (!has_normal && fv == 3) {
+				Eigen::Vector3f face_normal = (vertices->at(tmp[1]) - vertices->at(tmp[0])).cross(vertices->at(tmp[2]) - vertices->at(tmp[0]));
+				for (int v : tmp) {
+					normals->at(v) += face_normal;
+				}
+			}
 			faces->push_back(tmp);
 			index_offset += fv;
 		}
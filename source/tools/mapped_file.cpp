@@ -0,0 +1,112 @@
+﻿#include "mapped_file.h"
+
+#include <utility>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+	swap(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		swap(other);
+	}
+	return *this;
+}
+
+void MappedFile::swap(MappedFile& other) noexcept {
+	std::swap(opened, other.opened);
+	std::swap(view, other.view);
+	std::swap(length, other.length);
+#ifdef _WIN32
+	std::swap(file, other.file);
+	std::swap(mapping, other.mapping);
+#endif
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+	close();
+	// 渐进传输时其他进程还在追加写入文件，共享写和删除才能在写入期间打开
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	file = handle;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(handle, &file_size)) {
+		close();
+		return false;
+	}
+	length = size_t(file_size.QuadPart);
+	opened = true;
+	// 空文件不能创建映射
+	if (length == 0) return true;
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		return false;
+	}
+	view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (view == nullptr) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+	if (view != nullptr) UnmapViewOfFile(view);
+	if (mapping != nullptr) CloseHandle(mapping);
+	if (file != nullptr) CloseHandle(file);
+	view = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	length = 0;
+	opened = false;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat status;
+	if (fstat(fd, &status) != 0) {
+		::close(fd);
+		return false;
+	}
+	length = size_t(status.st_size);
+	if (length > 0) {
+		// 映射建立后关闭文件描述符不影响映射
+		void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED) {
+			::close(fd);
+			length = 0;
+			return false;
+		}
+		view = static_cast<const char*>(address);
+	}
+	::close(fd);
+	opened = true;
+	return true;
+}
+
+void MappedFile::close() {
+	if (view != nullptr) munmap(const_cast<char*>(view), length);
+	view = nullptr;
+	length = 0;
+	opened = false;
+}
+#endif
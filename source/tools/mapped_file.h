@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+
+// 只读映射整个文件，读取时直接访问映射的内存，不复制文件内容
+// Windows使用CreateFileMapping/MapViewOfFile，其他平台使用mmap
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	// 映射文件，失败时返回false；空文件可以打开，data()为空指针
+	// 映射的长度为打开时的文件大小，之后追加的内容需要重新open；其他进程可以在映射期间继续追加写入
+	bool open(const std::string& path);
+	// 解除映射，之后data()返回的指针失效
+	void close();
+	bool is_open() const { return opened; }
+	const char* data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+	bool opened = false;
+	const char* view = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file = nullptr; // HANDLE
+	void* mapping = nullptr; // HANDLE
+#endif
+
+	void swap(MappedFile& other) noexcept;
+};
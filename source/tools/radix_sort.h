@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <tools/thread_pool.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// 对由W个64位字组成的定长键做稳定的LSD基数排序，键按key[0], key[1], ...的字典序升序排列
+// 每趟处理一个字节：各块并行统计直方图，按(字节值, 块号)的顺序求出写入位置后再并行分发
+// 分块大小固定，所有字节都相同的趟直接跳过，结果与线程数无关
+template <size_t W>
+void radix_sort(std::vector<std::array<uint64_t, W>>& keys, ThreadPool& pool) {
+	const int block = 1 << 14;
+	int n = int(keys.size());
+	if (n <= 1) return;
+	int blocks = (n + block - 1) / block;
+	std::vector<std::array<uint64_t, W>> buffer(n);
+	std::vector<std::array<int, 256>> histogram(blocks);
+	for (int word = int(W) - 1; word >= 0; --word) {
+		for (int shift = 0; shift < 64; shift += 8) {
+			pool.parallel_for(0, blocks, [&](int b, int) {
+				auto& count = histogram[b];
+				count.fill(0);
+				int last = std::min(n, (b + 1) * block);
+				for (int i = b * block; i < last; ++i) {
+					++count[(keys[i][word] >> shift) & 0xff];
+				}
+			});
+			// 所有键在这一字节上相同时不需要移动
+			int digit = int((keys[0][word] >> shift) & 0xff);
+			int total = 0;
+			for (int b = 0; b < blocks; ++b) total += histogram[b][digit];
+			if (total == n) continue;
+			// 直方图原地转换为每块每个字节值的写入起点
+			int offset = 0;
+			for (int d = 0; d < 256; ++d) {
+				for (int b = 0; b < blocks; ++b) {
+					int count = histogram[b][d];
+					histogram[b][d] = offset;
+					offset += count;
+				}
+			}
+			pool.parallel_for(0, blocks, [&](int b, int) {
+				auto& position = histogram[b];
+				int last = std::min(n, (b + 1) * block);
+				for (int i = b * block; i < last; ++i) {
+					buffer[position[(keys[i][word] >> shift) & 0xff]++] = keys[i];
+				}
+			});
+			keys.swap(buffer);
+		}
+	}
+}
+
+// 排序后去除重复的键
+template <size_t W>
+void radix_sort_unique(std::vector<std::array<uint64_t, W>>& keys, ThreadPool& pool) {
+	radix_sort(keys, pool);
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
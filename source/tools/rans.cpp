@@ -0,0 +1,295 @@
+﻿#include "rans.h"
+
+#include <algorithm>
+#include <cstring>
+
+// AVX2内核不依赖编译选项(MSVC工程没有/arch:AVX2)，GCC和Clang用target属性单独为它生成AVX2指令，运行时按CPU是否支持选择
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define RANS_AVX2
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RANS_AVX2_TARGET
+#else
+#define RANS_AVX2_TARGET __attribute__((target("avx2,popcnt")))
+#endif
+#endif
+
+static const int prob_bits = 12;
+static const uint32_t prob_scale = 1u << prob_bits;
+static const uint32_t state_lower = 1u << 16; // 状态的下界，状态始终在[state_lower, 2^32)内
+static const int lanes = 32; // 交错的状态数，AVX2实现中为4个相互独立的8通道向量，以掩盖查表和乘法的延迟
+
+// 把字节的出现次数归一化为和为prob_scale的频率，出现过的字节频率至少为1
+static void normalize_frequency(const uint32_t* count, size_t total, uint32_t* freq) {
+	uint32_t sum = 0;
+	int largest = 0;
+	for (int s = 0; s < 256; ++s) {
+		freq[s] = count[s] == 0 ? 0 : std::max<uint32_t>(1, uint32_t(uint64_t(count[s]) * prob_scale / total));
+		sum += freq[s];
+		if (count[s] > count[largest]) largest = s;
+	}
+	// 舍入误差由出现次数最多的字节吸收，不够时从频率大于1的字节中逐个扣除
+	if (sum <= prob_scale || freq[largest] > sum - prob_scale) {
+		freq[largest] = freq[largest] + prob_scale - sum;
+		return;
+	}
+	int excess = sum - prob_scale;
+	excess -= freq[largest] - 1;
+	freq[largest] = 1;
+	for (int s = 0; s < 256 && excess > 0; ++s) {
+		int take = std::min<int>(excess, int(freq[s]) - 1);
+		if (take > 0) {
+			freq[s] -= take;
+			excess -= take;
+		}
+	}
+}
+
+// 编码一块，结果追加到out
+static void encode_chunk(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+	uint32_t count[256] = {}, freq[256], start[256];
+	for (size_t i = 0; i < size; ++i) ++count[data[i]];
+	normalize_frequency(count, size, freq);
+	uint8_t present[32] = {};
+	for (int s = 0, cumulative = 0; s < 256; ++s) {
+		start[s] = cumulative;
+		cumulative += freq[s];
+		if (freq[s] > 0) present[s >> 3] |= uint8_t(1u << (s & 7));
+	}
+
+	// 倒序编码，使解码时按正序读出；输出的字先倒序存放，最后翻转
+	uint32_t state[lanes];
+	std::fill(state, state + lanes, state_lower);
+	std::vector<uint16_t> words;
+	words.reserve(size / 2 + 16);
+	for (size_t i = size; i-- > 0; ) {
+		uint32_t& x = state[i % lanes];
+		uint32_t f = freq[data[i]];
+		if (x >= (uint64_t(state_lower >> prob_bits) << 16) * f) {
+			words.push_back(uint16_t(x & 0xffff));
+			x >>= 16;
+		}
+		x = ((x / f) << prob_bits) + (x % f) + start[data[i]];
+	}
+	std::reverse(words.begin(), words.end());
+
+	out.insert(out.end(), present, present + 32);
+	for (int s = 0; s < 256; ++s) {
+		if (freq[s] == 0) continue;
+		uint16_t value = uint16_t(freq[s] - 1); // 频率在[1, 4096]内，减1后可用16位保存
+		out.insert(out.end(), reinterpret_cast<const uint8_t*>(&value), reinterpret_cast<const uint8_t*>(&value) + 2);
+	}
+	out.insert(out.end(), reinterpret_cast<const uint8_t*>(state), reinterpret_cast<const uint8_t*>(state + lanes));
+	out.insert(out.end(), reinterpret_cast<const uint8_t*>(words.data()), reinterpret_cast<const uint8_t*>(words.data() + words.size()));
+}
+
+void rans_encode(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ThreadPool& pool) {
+	int chunks = int((size + rans_chunk_size - 1) / rans_chunk_size);
+	std::vector<std::vector<uint8_t>> encoded(chunks);
+	pool.parallel_for(0, chunks, [&](int i, int) {
+		size_t first = size_t(i) * rans_chunk_size;
+		encode_chunk(data + first, std::min<size_t>(rans_chunk_size, size - first), encoded[i]);
+	});
+	out.clear();
+	uint64_t raw_size = size;
+	uint32_t header[2] = { rans_chunk_size, uint32_t(chunks) };
+	out.insert(out.end(), reinterpret_cast<const uint8_t*>(&raw_size), reinterpret_cast<const uint8_t*>(&raw_size + 1));
+	out.insert(out.end(), reinterpret_cast<const uint8_t*>(header), reinterpret_cast<const uint8_t*>(header + 2));
+	for (const auto& chunk : encoded) {
+		uint32_t bytes = chunk.size();
+		out.insert(out.end(), reinterpret_cast<const uint8_t*>(&bytes), reinterpret_cast<const uint8_t*>(&bytes + 1));
+	}
+	for (const auto& chunk : encoded) {
+		out.insert(out.end(), chunk.begin(), chunk.end());
+	}
+}
+
+// 解码表：slot -> 字节 | (频率 - 1) << 8 | 起点 << 20，一次查表得到解码所需的全部信息
+static bool read_table(const uint8_t*& data, const uint8_t* end, uint32_t* table) {
+	if (end - data < 32) return false;
+	const uint8_t* present = data;
+	data += 32;
+	uint32_t cumulative = 0;
+	for (int s = 0; s < 256; ++s) {
+		if (!(present[s >> 3] & (1u << (s & 7)))) continue;
+		if (end - data < 2) return false;
+		uint16_t value;
+		std::memcpy(&value, data, 2);
+		data += 2;
+		uint32_t f = uint32_t(value) + 1;
+		if (cumulative + f > prob_scale) return false;
+		for (uint32_t slot = cumulative; slot < cumulative + f; ++slot) {
+			table[slot] = uint32_t(s) | (f - 1) << 8 | cumulative << 20;
+		}
+		cumulative += f;
+	}
+	return cumulative == prob_scale;
+}
+
+// 解码一个字节并在需要时读入16位，words到达末尾时状态不再补充(数据损坏时在最后检查)
+static inline uint8_t decode_symbol(uint32_t& x, const uint32_t* table, const uint8_t*& words, const uint8_t* words_end) {
+	uint32_t slot = x & (prob_scale - 1);
+	uint32_t entry = table[slot];
+	x = ((entry >> 8 & 0xfff) + 1) * (x >> prob_bits) + slot - (entry >> 20);
+	if (x < state_lower && words < words_end) {
+		uint16_t word;
+		std::memcpy(&word, words, 2);
+		words += 2;
+		x = x << 16 | word;
+	}
+	return uint8_t(entry);
+}
+
+#if defined(RANS_AVX2)
+// CPU和操作系统是否支持AVX2(操作系统须保存YMM寄存器)
+static bool cpu_supports_avx2() {
+#if defined(__AVX2__)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	const int osxsave_avx = 1 << 27 | 1 << 28;
+	if ((info[2] & osxsave_avx) != osxsave_avx || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & 1 << 5) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// 8个通道各解码一个字节并更新状态，need为状态低于下界、需要读入一个字的通道
+static inline RANS_AVX2_TARGET void decode_vector(__m256i& x, __m256i& need, const uint32_t* table, uint8_t* dst) {
+	const __m256i slot_mask = _mm256_set1_epi32(prob_scale - 1);
+	const __m256i freq_mask = _mm256_set1_epi32(0xfff);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i lower = _mm256_set1_epi32(state_lower - 1);
+	const __m256i byte_shuffle = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m256i slot = _mm256_and_si256(x, slot_mask);
+	__m256i entry = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), slot, 4);
+	__m256i freq = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(entry, 8), freq_mask), one);
+	x = _mm256_sub_epi32(_mm256_add_epi32(_mm256_mullo_epi32(freq, _mm256_srli_epi32(x, prob_bits)), slot), _mm256_srli_epi32(entry, 20));
+	__m256i bytes = _mm256_shuffle_epi8(entry, byte_shuffle);
+	uint32_t low = uint32_t(_mm_cvtsi128_si32(_mm256_castsi256_si128(bytes)));
+	uint32_t high = uint32_t(_mm_cvtsi128_si32(_mm256_extracti128_si256(bytes, 1)));
+	std::memcpy(dst, &low, 4);
+	std::memcpy(dst + 4, &high, 4);
+	// x < state_lower即min(x, state_lower - 1) == x
+	need = _mm256_cmpeq_epi32(_mm256_min_epu32(x, lower), x);
+}
+
+// 需要读入的通道按通道顺序依次取连续的字，permutation[mask]把这些字分配到对应的通道
+static inline RANS_AVX2_TARGET void refill(__m256i& x, const __m256i& need, const uint32_t* permutation, const uint8_t*& words) {
+	int mask = _mm256_movemask_ps(_mm256_castsi256_ps(need));
+	__m256i next = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(words)));
+	next = _mm256_permutevar8x32_epi32(next, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(permutation + mask * 8)));
+	x = _mm256_blendv_epi8(x, _mm256_or_si256(_mm256_slli_epi32(x, 16), next), need);
+	words += 2 * _mm_popcnt_u32(uint32_t(mask));
+}
+
+// 用AVX2每轮更新4组8个状态，返回解码的字节数，剩余不足一轮的部分交给标量实现
+static RANS_AVX2_TARGET size_t decode_avx2(uint32_t* state, const uint32_t* table, const uint8_t*& words, const uint8_t* words_end, uint8_t* out, size_t size) {
+	static const auto permutation = []() {
+		std::vector<uint32_t> table(256 * 8, 0);
+		for (int mask = 0; mask < 256; ++mask) {
+			for (int lane = 0, rank = 0; lane < 8; ++lane) {
+				if (mask & (1 << lane)) table[mask * 8 + lane] = rank++;
+			}
+		}
+		return table;
+	}();
+	// 4组状态显式展开，保证都留在寄存器中
+	__m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state));
+	__m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 8));
+	__m256i x2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 16));
+	__m256i x3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 24));
+	__m256i need0, need1, need2, need3;
+	size_t i = 0;
+	// 每轮最多读入lanes个字
+	for (; i + lanes <= size && words + 2 * lanes <= words_end; i += lanes) {
+		decode_vector(x0, need0, table, out + i);
+		decode_vector(x1, need1, table, out + i + 8);
+		decode_vector(x2, need2, table, out + i + 16);
+		decode_vector(x3, need3, table, out + i + 24);
+		refill(x0, need0, permutation.data(), words);
+		refill(x1, need1, permutation.data(), words);
+		refill(x2, need2, permutation.data(), words);
+		refill(x3, need3, permutation.data(), words);
+	}
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state), x0);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 8), x1);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 16), x2);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 24), x3);
+	return i;
+}
+#endif
+
+// 解码一块，vectorized为false时只用标量实现
+static bool decode_chunk(const uint8_t* data, size_t bytes, uint8_t* out, size_t size, bool vectorized) {
+	const uint8_t* end = data + bytes;
+	uint32_t table[prob_scale];
+	if (!read_table(data, end, table) || size_t(end - data) < sizeof(uint32_t) * lanes) return false;
+	uint32_t state[lanes];
+	std::memcpy(state, data, sizeof(state));
+	data += sizeof(state);
+	// 16位字流，起点不一定按2字节对齐，均按memcpy或非对齐加载读取
+	if ((end - data) % 2 != 0) return false;
+	const uint8_t* words = data;
+	const uint8_t* words_end = end;
+
+	size_t i = 0;
+#if defined(RANS_AVX2)
+	static const bool avx2 = cpu_supports_avx2();
+	if (vectorized && avx2) {
+		i = decode_avx2(state, table, words, words_end, out, size);
+	}
+#endif
+	for (; i < size; ++i) {
+		out[i] = decode_symbol(state[i % lanes], table, words, words_end);
+	}
+	// 所有字恰好读完，且状态回到编码时的初值
+	if (words != words_end) return false;
+	for (int lane = 0; lane < lanes; ++lane) {
+		if (state[lane] != state_lower) return false;
+	}
+	return true;
+}
+
+static bool decode(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ThreadPool& pool, bool vectorized) {
+	const size_t header_size = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+	if (size < header_size) return false;
+	uint64_t raw_size;
+	uint32_t header[2];
+	std::memcpy(&raw_size, data, sizeof(raw_size));
+	std::memcpy(header, data + sizeof(raw_size), sizeof(header));
+	uint32_t chunk_size = header[0], chunks = header[1];
+	if (chunk_size == 0 || (raw_size + chunk_size - 1) / chunk_size != chunks || size - header_size < sizeof(uint32_t) * uint64_t(chunks)) {
+		return false;
+	}
+	std::vector<uint32_t> chunk_bytes(chunks);
+	if (chunks > 0) std::memcpy(chunk_bytes.data(), data + header_size, sizeof(uint32_t) * chunks);
+	std::vector<size_t> chunk_offset(chunks + 1, header_size + sizeof(uint32_t) * chunks);
+	for (uint32_t i = 0; i < chunks; ++i) {
+		chunk_offset[i + 1] = chunk_offset[i] + chunk_bytes[i];
+	}
+	if (chunk_offset[chunks] > size) return false;
+
+	out.resize(raw_size);
+	std::vector<char> ok(chunks, 0);
+	pool.parallel_for(0, int(chunks), [&](int i, int) {
+		size_t first = size_t(i) * chunk_size;
+		ok[i] = decode_chunk(data + chunk_offset[i], chunk_bytes[i], out.data() + first, std::min<size_t>(chunk_size, raw_size - first), vectorized);
+	});
+	return std::all_of(ok.begin(), ok.end(), [](char value) { return value != 0; });
+}
+
+bool rans_decode(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ThreadPool& pool) {
+	return decode(data, size, out, pool, true);
+}
+
+bool rans_decode_scalar(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ThreadPool& pool) {
+	return decode(data, size, out, pool, false);
+}
@@ -0,0 +1,20 @@
+﻿#pragma once
+
+#include <tools/thread_pool.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 按字节的交错rANS熵编码：32位状态，每次输出16位，概率精度12位，32个状态轮流编码相邻的字节
+// 输入按rans_chunk_size字节分块，每块单独统计静态频率表，块之间相互独立，可以并行编解码
+// 编码结果：原始字节数(uint64)、块大小(uint32)、块数(uint32)、每块的字节数(uint32 × 块数)，然后依次是各块
+// 每块：出现过的字节的位图(32字节)、这些字节的频率(uint16)、32个状态的初值(uint32)、16位输出流
+constexpr uint32_t rans_chunk_size = 1 << 16;
+
+// 编码size字节的data，结果写入out
+void rans_encode(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ThreadPool& pool);
+// 解码rans_encode的结果，数据损坏时返回false
+// CPU支持AVX2时(运行时检测，与编译选项无关)每轮更新4组8个状态，否则退化为标量实现
+bool rans_decode(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ThreadPool& pool);
+// 标量实现，用于对照和基准测试
+bool rans_decode_scalar(const uint8_t* data, size_t size, std::vector<uint8_t>& out, ThreadPool& pool);
@@ -0,0 +1,100 @@
+﻿#include "thread_pool.h"
+
+#include <algorithm>
+
+// 当前线程正在执行的任务所用的线程号，不在任务中时为-1，用于识别嵌套调用
+static thread_local int current_thread = -1;
+
+ThreadPool::ThreadPool() {
+}
+
+ThreadPool::~ThreadPool() {
+	shutdown();
+}
+
+void ThreadPool::init(int _threads) {
+	shutdown();
+	threads = _threads > 0 ? _threads : std::max(1, int(std::thread::hardware_concurrency()));
+	stop = false;
+	for (int i = 1; i < threads; ++i) {
+		workers.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+}
+
+void ThreadPool::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	job_ready.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	std::vector<std::thread>().swap(workers);
+	threads = 1;
+	// 新的工作线程从seen_generation = 0开始，必须同时清零，否则重新init后会把上一轮的generation当作新任务
+	generation = 0;
+	running = 0;
+}
+
+void ThreadPool::run_job(int thread_index) {
+	current_thread = thread_index;
+	while (true) {
+		int first = job_next.fetch_add(job_grain);
+		if (first >= job_end) break;
+		int last = std::min(first + job_grain, job_end);
+		for (int i = first; i < last; ++i) {
+			(*job)(i, thread_index);
+		}
+	}
+	current_thread = -1;
+}
+
+void ThreadPool::worker_loop(int thread_index) {
+	long long seen_generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_ready.wait(lock, [&]() { return stop || generation != seen_generation; });
+			if (stop) return;
+			seen_generation = generation;
+		}
+		run_job(thread_index);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0) job_done.notify_one();
+		}
+	}
+}
+
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int, int)>& func, int grain) {
+	if (begin >= end) return;
+	// 嵌套调用时所有线程都已被外层任务占用，直接串行执行
+	if (current_thread >= 0) {
+		for (int i = begin; i < end; ++i) {
+			func(i, current_thread);
+		}
+		return;
+	}
+	// 单线程或任务量不足一块时直接在调用线程执行
+	if (workers.empty() || end - begin <= grain) {
+		for (int i = begin; i < end; ++i) {
+			func(i, 0);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &func;
+		job_end = end;
+		job_grain = std::max(1, grain);
+		job_next.store(begin);
+		running = int(workers.size());
+		++generation;
+	}
+	job_ready.notify_all();
+	run_job(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	job_done.wait(lock, [&]() { return running == 0; });
+	job = nullptr;
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	// 初始化，_threads <= 0时使用全部硬件线程
+	void init(int _threads);
+	// 线程数(包括调用线程)
+	int size() const { return threads; }
+	// 把[begin, end)按grain分块交给所有线程执行func(i, thread_index)，调用线程也参与执行，所有任务完成后返回
+	// 同一个i只会被执行一次，func写入不同位置时结果与线程数和调度顺序无关
+	// 在func内部再次调用时直接在当前线程串行执行，thread_index沿用外层任务的线程号
+	void parallel_for(int begin, int end, const std::function<void(int, int)>& func, int grain = 1);
+	// 有序归约：把[begin, end)按固定的block大小分块，各块并行地用map求部分结果，再按块的顺序依次combine
+	// 分块方式与线程数无关，因此浮点累加的顺序固定，结果逐位一致
+	template <typename T, typename Map, typename Combine>
+	T parallel_reduce(int begin, int end, int block, T init, Map map, Combine combine);
+
+private:
+	int threads = 1;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable job_ready;
+	std::condition_variable job_done;
+	bool stop = false;
+	long long generation = 0; // 每派发一次任务加一，工作线程据此判断是否有新任务
+	int running = 0; // 尚未完成当前任务的工作线程数
+
+	// 当前任务
+	const std::function<void(int, int)>* job = nullptr;
+	int job_end = 0;
+	int job_grain = 1;
+	std::atomic<int> job_next{ 0 };
+
+	void worker_loop(int thread_index);
+	void run_job(int thread_index);
+	void shutdown();
+};
+
+template <typename T, typename Map, typename Combine>
+T ThreadPool::parallel_reduce(int begin, int end, int block, T init, Map map, Combine combine) {
+	if (begin >= end) return init;
+	block = block > 0 ? block : 1;
+	int blocks = (end - begin + block - 1) / block;
+	std::vector<T> partial(blocks, init);
+	parallel_for(0, blocks, [&](int i, int) {
+		int first = begin + i * block;
+		int last = first + block < end ? first + block : end;
+		partial[i] = map(first, last);
+	});
+	T result = std::move(init);
+	for (auto& value : partial) {
+		result = combine(std::move(result), value);
+	}
+	return result;
+}